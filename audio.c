@@ -1174,6 +1174,7 @@ cRpiAudioDecoder::cRpiAudioDecoder(cOmx *omx) :
 	m_reset(false),
 	m_setupChanged(true),
 	m_wait(new cCondWait()),
+	m_spaceAvailable(new cCondWait()),
 	m_parser(new cParser()),
 	m_render(new cRpiAudioRender(omx))
 {
@@ -1187,6 +1188,7 @@ cRpiAudioDecoder::~cRpiAudioDecoder()
 
 	delete m_render;
 	delete m_parser;
+	delete m_spaceAvailable;
 	delete m_wait;
 }
 
@@ -1303,6 +1305,14 @@ bool cRpiAudioDecoder::Poll(void)
 	return m_parser->GetFreeSpace() > KILOBYTE(16);
 }
 
+bool cRpiAudioDecoder::WaitForSpace(int timeoutMs)
+{
+	if (!Poll() && timeoutMs > 0)
+		m_spaceAvailable->Wait(timeoutMs);
+
+	return Poll();
+}
+
 void cRpiAudioDecoder::HandleAudioSetupChanged()
 {
 	DBG("HandleAudioSetupChanged()");
@@ -1335,6 +1345,10 @@ void cRpiAudioDecoder::Action(void)
 			m_reset = false;
 		}
 
+		// wake up the device waiting for the parser to be drained
+		if (Poll())
+			m_spaceAvailable->Signal();
+
 		// test for codec change if there is data in parser and no left over
 		if (!m_parser->Empty() && !frame->nb_samples)
 			m_setupChanged |= codec != m_parser->GetCodec() ||
@@ -44,6 +44,9 @@ public:
 	virtual bool Poll(void);
 	virtual void Reset(void);
 
+	// wait until Poll() succeeds, signaled by the decoder thread
+	bool WaitForSpace(int timeoutMs);
+
 protected:
 
 	virtual void Action(void);
@@ -71,6 +74,7 @@ private:
 	bool		  	m_setupChanged;
 
 	cCondWait	 	*m_wait;
+	cCondWait	 	*m_spaceAvailable;
 	cParser		 	*m_parser;
 	cRpiAudioRender	*m_render;
 };
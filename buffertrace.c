@@ -0,0 +1,195 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "buffertrace.h"
+#include "tools.h"
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+#include <stdio.h>
+#include <string.h>
+
+volatile bool cRpiBufferTrace::s_active = false;
+struct cRpiBufferTrace::Record *cRpiBufferTrace::s_records = 0;
+volatile uint32_t cRpiBufferTrace::s_head = 0;
+uint32_t cRpiBufferTrace::s_start = 0;
+
+struct cRpiBufferTrace::Pending
+		cRpiBufferTrace::s_pending[2][BUFFERTRACE_PENDING];
+volatile uint32_t cRpiBufferTrace::s_pendingHead[2] = { 0, 0 };
+volatile uint32_t cRpiBufferTrace::s_pendingTail[2] = { 0, 0 };
+
+bool cRpiBufferTrace::Start(void)
+{
+	if (s_active)
+		return true;
+
+	// the records are kept until the process ends, since OMX callbacks may
+	// still be writing while the plugin is being shut down
+	if (!s_records)
+	{
+		s_records = MALLOC(struct Record, BUFFERTRACE_SIZE);
+		if (!s_records)
+		{
+			ELOG("failed to allocate buffer trace!");
+			return false;
+		}
+		memset(s_records, 0, sizeof(struct Record) * BUFFERTRACE_SIZE);
+	}
+
+	// the head is never reset, so stale slots can't match a sequence number
+	// of the current recording
+	s_start = s_head;
+	__sync_synchronize();
+	s_active = true;
+
+	DLOG("buffer trace started");
+	return true;
+}
+
+void cRpiBufferTrace::Stop(void)
+{
+	if (s_active)
+	{
+		s_active = false;
+		DLOG("buffer trace stopped, %u events recorded", s_head - s_start);
+	}
+}
+
+void cRpiBufferTrace::Write(ePort port, eEvent event, int64_t timestamp,
+		uint32_t flags, uint32_t length)
+{
+	uint32_t seq = __sync_fetch_and_add(&s_head, 1);
+	struct Record *record = &s_records[seq & (BUFFERTRACE_SIZE - 1)];
+
+	// invalidate slot while writing, so a concurrent dump will skip it
+	record->seq = 0;
+	__sync_synchronize();
+
+	record->time = cTimeUs::Now();
+	record->timestamp = timestamp;
+	record->flags = flags;
+	record->length = length;
+	record->thread = cThread::ThreadId();
+	record->port = port;
+	record->event = event;
+
+	__sync_synchronize();
+	record->seq = seq + 1;
+}
+
+void cRpiBufferTrace::Push(ePort port, int64_t timestamp, uint32_t flags,
+		uint32_t length)
+{
+	uint32_t head = s_pendingHead[port];
+	if (head - s_pendingTail[port] >= BUFFERTRACE_PENDING)
+		return;
+
+	struct Pending *pending = &s_pending[port][head & (BUFFERTRACE_PENDING - 1)];
+	pending->timestamp = timestamp;
+	pending->flags = flags;
+	pending->length = length;
+
+	__sync_synchronize();
+	s_pendingHead[port] = head + 1;
+}
+
+void cRpiBufferTrace::Pop(ePort port, int64_t &timestamp, uint32_t &flags,
+		uint32_t &length)
+{
+	uint32_t tail = s_pendingTail[port];
+	if (tail == s_pendingHead[port])
+		return;
+
+	__sync_synchronize();
+	struct Pending *pending = &s_pending[port][tail & (BUFFERTRACE_PENDING - 1)];
+	timestamp = pending->timestamp;
+	flags = pending->flags;
+	length = pending->length;
+
+	__sync_synchronize();
+	s_pendingTail[port] = tail + 1;
+}
+
+void cRpiBufferTrace::Revoke(ePort port)
+{
+	// the buffer hasn't reached OMX, so the consumer can't have taken it
+	if (s_pendingHead[port] != s_pendingTail[port])
+		s_pendingHead[port]--;
+}
+
+int cRpiBufferTrace::Dump(const char *fileName)
+{
+	if (!s_records)
+	{
+		ELOG("no buffer trace recorded!");
+		return -1;
+	}
+
+	FILE *file = fopen(fileName, "wb");
+	if (!file)
+	{
+		ELOG("failed to open %s for buffer trace!", fileName);
+		return -1;
+	}
+
+	uint32_t head = s_head;
+	uint32_t from = head - s_start > BUFFERTRACE_SIZE ?
+			head - BUFFERTRACE_SIZE : s_start;
+
+	uint32_t header[4] = { 0, 1, sizeof(struct Record), 0 };
+	memcpy(header, "RHBT", 4);
+
+	bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+	for (uint32_t seq = from; ok && seq != head; seq++)
+	{
+		struct Record *slot = &s_records[seq & (BUFFERTRACE_SIZE - 1)];
+		volatile uint32_t *slotSeq = &slot->seq;
+
+		// skip records being overwritten before or while copying them
+		if (*slotSeq != seq + 1)
+			continue;
+
+		__sync_synchronize();
+		struct Record record = *slot;
+		__sync_synchronize();
+
+		if (*slotSeq != seq + 1)
+			continue;
+
+		ok = fwrite(&record, sizeof(record), 1, file) == 1;
+		header[3]++;
+	}
+
+	// update number of records
+	if (ok)
+		ok = !fseek(file, 0, SEEK_SET) &&
+				fwrite(header, sizeof(header), 1, file) == 1;
+
+	if (fclose(file) || !ok)
+	{
+		ELOG("failed to write buffer trace to %s!", fileName);
+		return -1;
+	}
+
+	DLOG("dumped %u buffer trace events to %s", header[3], fileName);
+	return header[3];
+}
@@ -0,0 +1,129 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef BUFFER_TRACE_H
+#define BUFFER_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * In-memory trace of OMX buffer events. Recording can be switched on and off
+ * at runtime, writers never block: each record slot is claimed with an atomic
+ * increment and validated by its sequence number once it has been written.
+ *
+ * Dump file layout (host byte order):
+ *   header:  char magic[4] = "RHBT", uint32_t version, uint32_t recordSize,
+ *            uint32_t numRecords
+ *   records: numRecords x cRpiBufferTrace::Record, oldest first
+ */
+
+#define BUFFERTRACE_SIZE 65536 // number of records, must be a power of two
+
+// max. number of buffers passed to a port at once, must be a power of two
+#define BUFFERTRACE_PENDING 256
+
+class cRpiBufferTrace
+{
+
+public:
+
+	enum ePort {
+		eAudio,
+		eVideo
+	};
+
+	enum eEvent {
+		eGet,
+		eEmpty,
+		eEmptied
+	};
+
+	struct Record
+	{
+		uint64_t time;		// us, CLOCK_MONOTONIC
+		int64_t  timestamp;	// OMX buffer time stamp in us
+		uint32_t flags;		// OMX buffer flags
+		uint32_t length;	// filled length
+		uint32_t thread;	// thread ID
+		uint32_t seq;		// sequence number + 1, 0 if not valid
+		uint8_t  port;
+		uint8_t  event;
+		uint8_t  reserved[6];
+	};
+
+	static void Stop(void);
+
+	static bool Start(void);
+	static bool IsActive(void) { return s_active; }
+
+	static int Dump(const char *fileName);
+
+	// ilclient reports emptied buffers without their header, so the data of
+	// buffers passed to OMX is kept regardless of recording, and assigned
+	// to the emptied buffers in order. If passing a buffer fails, the event
+	// needs to be revoked.
+	static inline void Add(ePort port, eEvent event, int64_t timestamp = 0,
+			uint32_t flags = 0, uint32_t length = 0)
+	{
+		if (event == eEmpty)
+			Push(port, timestamp, flags, length);
+		else if (event == eEmptied)
+			Pop(port, timestamp, flags, length);
+
+		if (s_active)
+			Write(port, event, timestamp, flags, length);
+	}
+
+	static void Revoke(ePort port);
+
+private:
+
+	cRpiBufferTrace();
+
+	static void Write(ePort port, eEvent event, int64_t timestamp,
+			uint32_t flags, uint32_t length);
+
+	struct Pending
+	{
+		int64_t  timestamp;
+		uint32_t flags;
+		uint32_t length;
+	};
+
+	// single producer (passing buffers under the OMX lock) and single
+	// consumer (ilclient callback) per port
+	static void Push(ePort port, int64_t timestamp, uint32_t flags,
+			uint32_t length);
+	static void Pop(ePort port, int64_t &timestamp, uint32_t &flags,
+			uint32_t &length);
+
+	static struct Pending s_pending[2][BUFFERTRACE_PENDING];
+	static volatile uint32_t s_pendingHead[2];
+	static volatile uint32_t s_pendingTail[2];
+
+	static volatile bool s_active;
+	static struct Record *s_records;
+	static volatile uint32_t s_head;
+	static uint32_t s_start;
+
+	cRpiBufferTrace(const cRpiBufferTrace&);
+	cRpiBufferTrace& operator= (const cRpiBufferTrace&);
+};
+
+#endif
@@ -22,6 +22,7 @@
 #include "tools.h"
 #include "setup.h"
 
+#include <vdr/thread.h>
 #include <vdr/tools.h>
 
 extern "C" {
@@ -101,12 +102,25 @@ cRpiDisplay::cRpiDisplay(int id, int width, int height, int frameRate,
 	m_frameRate(frameRate),
 	m_aspectRatio(aspectRatio),
 	m_interlaced(interlaced),
-	m_fixedMode(fixedMode)
+	m_fixedMode(fixedMode),
+	m_mutex(new cMutex()),
+	m_snapshotMutex(new cMutex()),
+	m_snapshotDisplay(DISPMANX_NO_HANDLE)
 {
+	for (int i = 0; i < SNAPSHOT_RESOURCES; i++)
+	{
+		m_snapshotResources[i].handle = DISPMANX_NO_HANDLE;
+		m_snapshotResources[i].width = 0;
+		m_snapshotResources[i].height = 0;
+		m_snapshotResources[i].lastUse = 0;
+	}
 }
 
 cRpiDisplay::~cRpiDisplay()
 {
+	ReleaseSnapshot();
+	delete m_snapshotMutex;
+	delete m_mutex;
 }
 
 int cRpiDisplay::GetSize(int &width, int &height)
@@ -150,8 +164,12 @@ int cRpiDisplay::SetVideoFormat(const cVideoFrameFormat *frameFormat)
 {
 	cRpiDisplay* instance = GetInstance();
 	if (instance)
-		return instance->Update(frameFormat);
-
+	{
+		instance->m_mutex->Lock();
+		int ret = instance->Update(frameFormat);
+		instance->m_mutex->Unlock();
+		return ret;
+	}
 	return -1;
 }
 
@@ -195,28 +213,125 @@ int cRpiDisplay::Snapshot(unsigned char* frame, int width, int height)
 {
 	cRpiDisplay* instance = GetInstance();
 	if (instance)
-	{
-		DISPMANX_DISPLAY_HANDLE_T display = vc_dispmanx_display_open(
-				instance->m_id);
+		return instance->TakeSnapshot(frame, width, height);
+
+	return -1;
+}
+
+int cRpiDisplay::TakeSnapshot(unsigned char* frame, int width, int height)
+{
+	int ret = -1;
+	m_snapshotMutex->Lock();
+
+	if (m_snapshotDisplay == DISPMANX_NO_HANDLE)
+		m_snapshotDisplay = vc_dispmanx_display_open(m_id);
 
-		if (display)
+	// the display gets scaled to the resource's size while taking the
+	// snapshot, so pick the resource of this size or replace the least
+	// recently used one, unused resources have never been used
+	SnapshotResource *res = &m_snapshotResources[0];
+	for (int i = 0; i < SNAPSHOT_RESOURCES; i++)
+	{
+		SnapshotResource *r = &m_snapshotResources[i];
+		if (r->handle != DISPMANX_NO_HANDLE &&
+				r->width == width && r->height == height)
 		{
-			uint32_t image;
-			DISPMANX_RESOURCE_HANDLE_T res = vc_dispmanx_resource_create(
-					VC_IMAGE_RGB888, width, height, &image);
+			res = r;
+			break;
+		}
+		if (r->lastUse < res->lastUse)
+			res = r;
+	}
+
+	if (m_snapshotDisplay != DISPMANX_NO_HANDLE &&
+			(res->handle == DISPMANX_NO_HANDLE ||
+			res->width != width || res->height != height))
+	{
+		if (res->handle != DISPMANX_NO_HANDLE)
+			vc_dispmanx_resource_delete(res->handle);
 
-			vc_dispmanx_snapshot(display, res,
-					(DISPMANX_TRANSFORM_T)(DISPMANX_SNAPSHOT_PACK));
+		uint32_t image;
+		res->handle = vc_dispmanx_resource_create(
+				VC_IMAGE_RGB888, width, height, &image);
 
-			VC_RECT_T rect = { 0, 0, width, height };
-			vc_dispmanx_resource_read_data(res, &rect, frame, width * 3);
+		res->width = width;
+		res->height = height;
+	}
+
+	if (m_snapshotDisplay != DISPMANX_NO_HANDLE &&
+			res->handle != DISPMANX_NO_HANDLE)
+	{
+		VC_RECT_T rect = { 0, 0, width, height };
 
-			vc_dispmanx_resource_delete(res);
-			vc_dispmanx_display_close(display);
-			return 0;
+		if (!vc_dispmanx_snapshot(m_snapshotDisplay, res->handle,
+				(DISPMANX_TRANSFORM_T)(DISPMANX_SNAPSHOT_PACK)) &&
+			!vc_dispmanx_resource_read_data(res->handle, &rect,
+				frame, width * 3))
+			ret = 0;
+	}
+
+	// start over with the next snapshot, e.g. if the display has changed
+	if (ret)
+		ReleaseSnapshot();
+	else
+		res->lastUse = cTimeMs::Now();
+
+	m_snapshotMutex->Unlock();
+	return ret;
+}
+
+void cRpiDisplay::CheckSnapshotTimeout(void)
+{
+	// don't create the instance just for this
+	cRpiDisplay* instance = s_instance;
+	if (instance)
+	{
+		instance->m_snapshotMutex->Lock();
+		bool inUse = false;
+		for (int i = 0; i < SNAPSHOT_RESOURCES; i++)
+		{
+			SnapshotResource *r = &instance->m_snapshotResources[i];
+			if (r->handle != DISPMANX_NO_HANDLE &&
+					cTimeMs::Now() - r->lastUse > SNAPSHOT_IDLE_TIMEOUT)
+			{
+				DBG("releasing idle %dx%d snapshot resource",
+						r->width, r->height);
+				vc_dispmanx_resource_delete(r->handle);
+				r->handle = DISPMANX_NO_HANDLE;
+				r->lastUse = 0;
+			}
+			if (r->handle != DISPMANX_NO_HANDLE)
+				inUse = true;
+		}
+		if (!inUse && instance->m_snapshotDisplay != DISPMANX_NO_HANDLE)
+		{
+			vc_dispmanx_display_close(instance->m_snapshotDisplay);
+			instance->m_snapshotDisplay = DISPMANX_NO_HANDLE;
 		}
+		instance->m_snapshotMutex->Unlock();
 	}
-	return -1;
+}
+
+void cRpiDisplay::ReleaseSnapshot(void)
+{
+	m_snapshotMutex->Lock();
+
+	for (int i = 0; i < SNAPSHOT_RESOURCES; i++)
+	{
+		SnapshotResource *r = &m_snapshotResources[i];
+		if (r->handle != DISPMANX_NO_HANDLE)
+			vc_dispmanx_resource_delete(r->handle);
+
+		r->handle = DISPMANX_NO_HANDLE;
+		r->lastUse = 0;
+	}
+
+	if (m_snapshotDisplay != DISPMANX_NO_HANDLE)
+		vc_dispmanx_display_close(m_snapshotDisplay);
+
+	m_snapshotDisplay = DISPMANX_NO_HANDLE;
+
+	m_snapshotMutex->Unlock();
 }
 
 void cRpiDisplay::GetModeFormat(const cVideoFrameFormat *format,
@@ -20,8 +20,15 @@
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include <stdint.h>
+
 #include "tools.h"
 
+#define SNAPSHOT_IDLE_TIMEOUT 10000 // ms
+#define SNAPSHOT_RESOURCES    2
+
+class cMutex;
+
 class cRpiDisplay
 {
 
@@ -40,6 +47,9 @@ public:
 
 	static int Snapshot(unsigned char* frame, int width, int height);
 
+	// release snapshot resources unused for SNAPSHOT_IDLE_TIMEOUT
+	static void CheckSnapshotTimeout(void);
+
 	static int SetVideoFormat(const cVideoFrameFormat *frameFormat);
 
 protected:
@@ -50,6 +60,9 @@ protected:
 
 	int Update(const cVideoFrameFormat *videoFormat);
 
+	int TakeSnapshot(unsigned char* frame, int width, int height);
+	void ReleaseSnapshot(void);
+
 	virtual int SetMode(int width, int height, int frameRate, int aspectRatio,
 			cScanMode::eMode scanMode) {
 		return 0;
@@ -70,6 +83,23 @@ protected:
 	bool m_interlaced;
 	bool m_fixedMode;
 
+	// the format is set by the player as well as by OMX callbacks
+	cMutex  *m_mutex;
+
+	// dispmanx display and resources are kept open for subsequent snapshots,
+	// one resource per size, since the preview and screen grabs alternate
+	struct SnapshotResource
+	{
+		uint32_t handle;
+		int      width;
+		int      height;
+		uint64_t lastUse;
+	};
+
+	cMutex  *m_snapshotMutex;
+	uint32_t m_snapshotDisplay;
+	SnapshotResource m_snapshotResources[SNAPSHOT_RESOURCES];
+
 	static cRpiDisplay *s_instance;
 
 private:
@@ -0,0 +1,159 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "gopcache.h"
+#include "omx.h"
+#include "tools.h"
+
+#include <vdr/tools.h>
+
+#include <string.h>
+
+#define GOPCACHE_MIN_ALLOC (64 * 1024)
+
+cRpiGopCache::cRpiGopCache(int budget) :
+	m_budget(budget),
+	m_size(0),
+	m_numMappings(0),
+	m_mappingIndex(0)
+{
+}
+
+cRpiGopCache::~cRpiGopCache()
+{
+	Clear();
+}
+
+void cRpiGopCache::Delete(AccessUnit *unit)
+{
+	m_size -= unit->size;
+	free(unit->data);
+	delete unit;
+}
+
+void cRpiGopCache::Clear(void)
+{
+	while (!m_units.empty())
+	{
+		Delete(m_units.front());
+		m_units.pop_front();
+	}
+	m_numMappings = 0;
+	m_mappingIndex = 0;
+}
+
+void cRpiGopCache::Add(int64_t pts)
+{
+	// a repeated packet starts the same access unit again
+	if (!m_units.empty() && m_units.back()->pts == pts &&
+			!m_units.back()->length)
+		return;
+
+	if (!m_units.empty())
+	{
+		int64_t duration = m_units.back()->pts - pts;
+		m_units.back()->duration = duration < 0 ? -duration : duration;
+	}
+
+	AccessUnit *unit = new AccessUnit;
+	unit->data = 0;
+	unit->length = 0;
+	unit->size = 0;
+	unit->submitted = 0;
+	unit->pts = pts;
+	unit->duration = 0;
+
+	m_units.push_back(unit);
+}
+
+bool cRpiGopCache::Append(const unsigned char *data, int length)
+{
+	// skip data not belonging to an access unit
+	if (m_units.empty())
+		return true;
+
+	AccessUnit *unit = m_units.back();
+	if (unit->length + length > unit->size)
+	{
+		int size = unit->size ? unit->size : GOPCACHE_MIN_ALLOC;
+		while (size < unit->length + length)
+			size *= 2;
+
+		unsigned char *buf = (unsigned char *)realloc(unit->data, size);
+		if (!buf)
+		{
+			ELOG("failed to allocate %d bytes for GOP cache!", size);
+			return false;
+		}
+		m_size += size - unit->size;
+		unit->data = buf;
+		unit->size = size;
+	}
+
+	memcpy(unit->data + unit->length, data, length);
+	unit->length += length;
+	return true;
+}
+
+void cRpiGopCache::Pop(int64_t outPts, int64_t outDuration)
+{
+	if (m_units.size() < 2)
+		return;
+
+	AccessUnit *unit = m_units.front();
+	m_units.pop_front();
+
+	Mapping *mapping = &m_mappings[m_mappingIndex];
+	mapping->outPts = outPts;
+	mapping->outDuration = outDuration;
+	mapping->pts = unit->pts;
+	mapping->duration = unit->duration;
+
+	m_mappingIndex = (m_mappingIndex + 1) % GOPCACHE_MAPPINGS;
+	if (m_numMappings < GOPCACHE_MAPPINGS)
+		m_numMappings++;
+
+	Delete(unit);
+}
+
+int64_t cRpiGopCache::Translate(int64_t outPts) const
+{
+	const Mapping *found = 0;
+
+	// find the latest access unit presented before the given time stamp
+	for (int i = 0; i < m_numMappings; i++)
+	{
+		const Mapping *mapping = &m_mappings[i];
+		if (mapping->outPts <= outPts &&
+				(!found || mapping->outPts > found->outPts))
+			found = mapping;
+	}
+
+	if (!found)
+		return OMX_INVALID_PTS;
+
+	// interpolate towards the successor, which lies before in the stream
+	int64_t elapsed = outPts - found->outPts;
+	if (elapsed > found->outDuration)
+		elapsed = found->outDuration;
+
+	return found->outDuration ?
+			found->pts - elapsed * found->duration / found->outDuration :
+			found->pts;
+}
@@ -0,0 +1,113 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef GOP_CACHE_H
+#define GOP_CACHE_H
+
+#include <stdint.h>
+#include <deque>
+
+/*
+ * Cache of video access units for reverse playback. VDR delivers the
+ * independent frames of each GOP in reverse order, the cache holds them until
+ * their successor is known, so each frame's display duration can be derived
+ * from the PTS distance to its successor. Once released, the mapping of the
+ * new presentation time stamps to the stream's PTS is kept for GetSTC().
+ */
+
+#define GOPCACHE_MAPPINGS 16
+
+class cRpiGopCache
+{
+
+public:
+
+	struct AccessUnit
+	{
+		unsigned char *data;
+		int            length;
+		int            size;
+		int            submitted; // bytes already passed to the decoder
+		int64_t        pts;
+		int64_t        duration; // PTS distance to successor, 0 if unknown
+	};
+
+	cRpiGopCache(int budget);
+	virtual ~cRpiGopCache();
+
+	void Clear(void);
+
+	// start a new access unit, completes the previous one
+	void Add(int64_t pts);
+
+	// append data to the latest access unit, fails if out of memory
+	bool Append(const unsigned char *data, int length);
+
+	// true if complete access units pending and budget exceeded
+	bool Full(void) const {
+		return m_size >= m_budget && m_units.size() > 1;
+	}
+
+	bool IsEmpty(void) const { return m_units.empty(); }
+
+	// oldest complete access unit, 0 if none
+	const AccessUnit* Front(void) const {
+		return m_units.size() > 1 ? m_units.front() : 0;
+	}
+
+	// account data of the oldest complete access unit passed to the decoder
+	void Submitted(int length) {
+		if (m_units.size() > 1)
+			m_units.front()->submitted += length;
+	}
+
+	// remove oldest complete access unit, which will be presented
+	// at outPts for outDuration
+	void Pop(int64_t outPts, int64_t outDuration);
+
+	// translate presentation time stamp back to stream PTS, returns
+	// OMX_INVALID_PTS if no frame has been presented before
+	int64_t Translate(int64_t outPts) const;
+
+private:
+
+	struct Mapping
+	{
+		int64_t outPts;
+		int64_t outDuration;
+		int64_t pts;
+		int64_t duration;
+	};
+
+	void Delete(AccessUnit *unit);
+
+	std::deque<AccessUnit*> m_units;
+
+	int m_budget;
+	int m_size;
+
+	Mapping m_mappings[GOPCACHE_MAPPINGS];
+	int     m_numMappings;
+	int     m_mappingIndex;
+
+	cRpiGopCache(const cRpiGopCache&);
+	cRpiGopCache& operator= (const cRpiGopCache&);
+};
+
+#endif
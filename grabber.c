@@ -0,0 +1,320 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "grabber.h"
+#include "display.h"
+#include "tools.h"
+
+#include <vdr/tools.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// log statistics every n-th frame
+#define GRABBER_STAT_INTERVAL 300
+
+cRpiFrameGrabber *cRpiFrameGrabber::s_instance = 0;
+cMutex cRpiFrameGrabber::s_mutex;
+
+cRpiFrameGrabber::cRpiFrameGrabber(int fps, int width, int height) :
+	cThread("frame grabber"),
+	m_fps(fps),
+	m_width(width),
+	m_height(height),
+	m_frameSize(width * height * 3),
+	m_region(0),
+	m_regionSize(0),
+	m_shared(false),
+	m_wait(new cCondWait()),
+	m_frames(0),
+	m_failed(0),
+	m_cpuTotal(0),
+	m_cpuMax(0),
+	m_wallTotal(0),
+	m_wallMax(0)
+{
+}
+
+cRpiFrameGrabber::~cRpiFrameGrabber()
+{
+	Cancel(-1);
+	m_wait->Signal();
+
+	while (Active())
+		cCondWait::SleepMs(5);
+
+	if (m_shared)
+	{
+		munmap(m_region, m_regionSize);
+		unlink(GRABBER_SHM_FILE);
+	}
+	else
+		free(m_region);
+
+	delete m_wait;
+}
+
+bool cRpiFrameGrabber::Init(void)
+{
+	// keep frame data aligned to the cache line size
+	int headerSize = (sizeof(Header) + 63) & ~63;
+	m_regionSize = headerSize + 2 * m_frameSize;
+
+	// replace an existing file instead of resizing it, so readers holding a
+	// mapping of the previous region won't fault
+	unlink(GRABBER_SHM_FILE);
+	// the frames show whatever is on screen, so keep them to VDR's user
+	int fd = open(GRABBER_SHM_FILE, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0)
+	{
+		if (!ftruncate(fd, m_regionSize))
+		{
+			void *region = mmap(0, m_regionSize, PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0);
+			if (region != MAP_FAILED)
+			{
+				m_region = (Header*)region;
+				m_shared = true;
+			}
+		}
+		close(fd);
+		if (!m_shared)
+			unlink(GRABBER_SHM_FILE);
+	}
+
+	// still provide the frames to other plugins
+	if (!m_shared)
+	{
+		ELOG("failed to create %s, preview only available in-process!",
+				GRABBER_SHM_FILE);
+		m_region = (Header*)MALLOC(unsigned char, m_regionSize);
+		if (!m_region)
+		{
+			ELOG("failed to allocate preview buffer!");
+			return false;
+		}
+	}
+
+	memset(m_region, 0, headerSize);
+	memcpy(m_region->magic, "RHPV", 4);
+	m_region->version = 1;
+	m_region->width = m_width;
+	m_region->height = m_height;
+	for (int i = 0; i < 2; i++)
+		m_region->slots[i].offset = headerSize + i * m_frameSize;
+
+	cThread::Start();
+	return true;
+}
+
+void cRpiFrameGrabber::Action(void)
+{
+	// below the video path, the preview is not worth a missed frame
+	SetPriority(10);
+	DLOG("frame grabber started, %d fps at %dx%d",
+			m_fps, m_width, m_height);
+
+	uint32_t frame = 0;
+	int slot = 1;
+
+	while (Running())
+	{
+		cTimeMs start;
+
+		// write into the slot readers don't expect the latest frame in
+		slot ^= 1;
+		Slot *s = &m_region->slots[slot];
+		s->seq = 0;
+		__sync_synchronize();
+
+		uint64_t wall = cTimeUs::Now();
+		uint64_t cpu = cTimeUs::ThreadCpu();
+
+		bool ok = !cRpiDisplay::Snapshot((unsigned char*)m_region + s->offset,
+				m_width, m_height);
+
+		cpu = cTimeUs::ThreadCpu() - cpu;
+		wall = cTimeUs::Now() - wall;
+
+		if (ok)
+		{
+			// never hand out 0, which marks a slot as invalid
+			if (!++frame)
+				++frame;
+
+			s->time = cTimeMs::Now();
+			__sync_synchronize();
+			s->seq = frame;
+			m_region->latest = slot;
+			__sync_synchronize();
+
+			m_statMutex.Lock();
+			m_frames++;
+			m_cpuTotal += cpu;
+			m_wallTotal += wall;
+			if (cpu > m_cpuMax)
+				m_cpuMax = cpu;
+			if (wall > m_wallMax)
+				m_wallMax = wall;
+
+			if (m_frames % GRABBER_STAT_INTERVAL == 0)
+				DLOG("frame grabber: %u frames, cpu avg=%llu max=%llu us, "
+						"wall avg=%llu max=%llu us", m_frames,
+						m_cpuTotal / m_frames, m_cpuMax,
+						m_wallTotal / m_frames, m_wallMax);
+			m_statMutex.Unlock();
+		}
+		else
+		{
+			// keep previous frame, slot remains invalid until next write
+			slot ^= 1;
+			m_statMutex.Lock();
+			bool first = !m_failed++;
+			m_statMutex.Unlock();
+			if (first)
+				ELOG("failed to grab preview frame!");
+		}
+
+		// keep the frame rate, but don't catch up after delays
+		int remaining = 1000 / m_fps - (int)start.Elapsed();
+		if (remaining > 0)
+			m_wait->Wait(remaining);
+	}
+	DLOG("frame grabber stopped");
+}
+
+bool cRpiFrameGrabber::Read(RpiHdDevice_GetPreview_v1_0 *preview)
+{
+	preview->width = m_width;
+	preview->height = m_height;
+	preview->frame = 0;
+	preview->time = 0;
+
+	if (!preview->data)
+		return true;
+
+	if (preview->size < m_frameSize)
+		return false;
+
+	// a frame is written every 200ms at most, so a copy will hardly ever
+	// race with the writer, but if so, the other slot has a complete frame
+	for (int retry = 0; retry < 2; retry++)
+	{
+		Slot *s = &m_region->slots[m_region->latest];
+		uint32_t seq = s->seq;
+		if (!seq)
+			continue;
+
+		__sync_synchronize();
+		uint64_t time = s->time;
+		memcpy(preview->data, (unsigned char*)m_region + s->offset,
+				m_frameSize);
+		__sync_synchronize();
+
+		if (s->seq == seq)
+		{
+			preview->frame = seq;
+			preview->time = time;
+			break;
+		}
+	}
+	return true;
+}
+
+bool cRpiFrameGrabber::Start(int fps, int width, int height)
+{
+	fps = constrain(fps, GRABBER_MIN_FPS, GRABBER_MAX_FPS);
+
+	if (width < 16 || height < 16 || width > 1920 || height > 1080)
+	{
+		ELOG("invalid preview size %dx%d!", width, height);
+		return false;
+	}
+
+	Stop();
+
+	cRpiFrameGrabber *instance = new cRpiFrameGrabber(fps, width, height);
+	if (!instance->Init())
+	{
+		delete instance;
+		return false;
+	}
+
+	s_mutex.Lock();
+	s_instance = instance;
+	s_mutex.Unlock();
+	return true;
+}
+
+void cRpiFrameGrabber::Stop(void)
+{
+	s_mutex.Lock();
+	cRpiFrameGrabber *instance = s_instance;
+	s_instance = 0;
+	s_mutex.Unlock();
+
+	if (instance)
+	{
+		instance->m_statMutex.Lock();
+		if (instance->m_frames)
+			DLOG("frame grabber: %u frames, %u failed, cpu avg=%llu us",
+					instance->m_frames, instance->m_failed,
+					instance->m_cpuTotal / instance->m_frames);
+		instance->m_statMutex.Unlock();
+		delete instance;
+	}
+}
+
+bool cRpiFrameGrabber::GetFrame(RpiHdDevice_GetPreview_v1_0 *preview)
+{
+	bool ret = false;
+
+	s_mutex.Lock();
+	if (s_instance)
+		ret = s_instance->Read(preview);
+	s_mutex.Unlock();
+
+	return ret;
+}
+
+cString cRpiFrameGrabber::Status(void)
+{
+	cString ret = "preview is off";
+
+	s_mutex.Lock();
+	cRpiFrameGrabber *g = s_instance;
+	if (g)
+	{
+		g->m_statMutex.Lock();
+		uint32_t frames = g->m_frames ? g->m_frames : 1;
+		ret = cString::sprintf("preview is on, %d fps at %dx%d, "
+				"%u frames (%u failed), cpu per frame avg=%llu max=%llu us, "
+				"wall per frame avg=%llu max=%llu us%s",
+				g->m_fps, g->m_width, g->m_height, g->m_frames, g->m_failed,
+				g->m_cpuTotal / frames, g->m_cpuMax,
+				g->m_wallTotal / frames, g->m_wallMax,
+				g->m_shared ? ", shared in " GRABBER_SHM_FILE : "");
+		g->m_statMutex.Unlock();
+	}
+	s_mutex.Unlock();
+
+	return ret;
+}
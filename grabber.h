@@ -0,0 +1,139 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef GRABBER_H
+#define GRABBER_H
+
+#include <stdint.h>
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+/*
+ * Low-rate live preview of the display. A background thread takes downscaled
+ * snapshots and writes them alternately into two frame slots of a shared
+ * region, which is mapped from GRABBER_SHM_FILE, so other processes of VDR's
+ * user can read the latest frame as well. Neither the writer nor readers ever block: a slot's
+ * sequence number is cleared while it is written, so a reader copies the slot
+ * given by 'latest' and only accepts the frame if the slot's sequence number
+ * didn't change meanwhile.
+ *
+ * Region layout (host byte order):
+ *   header: char magic[4] = "RHPV", uint32_t version, uint32_t width,
+ *           uint32_t height, uint32_t latest, uint32_t reserved,
+ *           2 x cRpiFrameGrabber::Slot
+ *   frames: 2 x width * height * 3 bytes RGB888 at Slot::offset
+ *
+ * The file is re-created with each start, so readers holding a mapping of a
+ * previous region should check whether the file has been replaced.
+ */
+
+#define GRABBER_SHM_FILE  "/dev/shm/rpihddevice-preview"
+
+#define GRABBER_MIN_FPS    1
+#define GRABBER_MAX_FPS    5
+#define GRABBER_DEF_FPS    2
+#define GRABBER_DEF_WIDTH  320
+#define GRABBER_DEF_HEIGHT 180
+
+/*
+ * Plugin service "RpiHdDevice-GetPreview-v1.0": copies the latest frame to
+ * data, if size is sufficient. Call with data = 0 to query the dimensions.
+ * The service returns false if the preview hasn't been started.
+ */
+struct RpiHdDevice_GetPreview_v1_0
+{
+	unsigned char *data;  // RGB888, width * height * 3 bytes
+	int            size;
+	int            width;
+	int            height;
+	uint32_t       frame; // frame number, 0 if no frame available (yet)
+	uint64_t       time;  // ms, cTimeMs::Now() when frame was grabbed
+};
+
+class cRpiFrameGrabber : public cThread
+{
+
+public:
+
+	struct Slot
+	{
+		uint32_t seq;     // frame number, 0 while being written
+		uint32_t offset;  // of frame data from start of region
+		uint64_t time;
+	};
+
+	static bool Start(int fps, int width, int height);
+	static void Stop(void);
+	static bool IsActive(void) { return s_instance != 0; }
+
+	// copies latest frame, returns false if not active or buffer too small
+	static bool GetFrame(RpiHdDevice_GetPreview_v1_0 *preview);
+
+	static cString Status(void);
+
+protected:
+
+	virtual void Action(void);
+
+private:
+
+	struct Header
+	{
+		char     magic[4];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t latest;
+		uint32_t reserved;
+		Slot     slots[2];
+	};
+
+	cRpiFrameGrabber(int fps, int width, int height);
+	virtual ~cRpiFrameGrabber();
+
+	bool Init(void);
+	bool Read(RpiHdDevice_GetPreview_v1_0 *preview);
+
+	static cRpiFrameGrabber *s_instance;
+	static cMutex s_mutex;
+
+	int m_fps;
+	int m_width;
+	int m_height;
+	int m_frameSize;
+
+	Header        *m_region;
+	int            m_regionSize;
+	bool           m_shared;
+	cCondWait     *m_wait;
+
+	// statistics, updated by the grabber thread
+	cMutex   m_statMutex;
+	uint32_t m_frames;
+	uint32_t m_failed;
+	uint64_t m_cpuTotal;  // us
+	uint64_t m_cpuMax;
+	uint64_t m_wallTotal;
+	uint64_t m_wallMax;
+
+	cRpiFrameGrabber(const cRpiFrameGrabber&);
+	cRpiFrameGrabber& operator= (const cRpiFrameGrabber&);
+};
+
+#endif
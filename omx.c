@@ -22,6 +22,8 @@
 #include "omx.h"
 #include "display.h"
 #include "setup.h"
+#include "zapstat.h"
+#include "buffertrace.h"
 
 #include <vdr/tools.h>
 #include <vdr/thread.h>
@@ -36,10 +38,29 @@ extern "C" {
 #define OMX_VIDEO_BUFFERS 128
 #define OMX_VIDEO_BUFFERSIZE KILOBYTE(64);
 
+// video buffer fill level in percent at which PollVideo() starts to refuse
+// data, and at which data is accepted again - the gap avoids that the player
+// gets woken up and rejected for every single buffer being returned
+#define OMX_VIDEO_BUFFERS_HIGH_WATER 90
+#define OMX_VIDEO_BUFFERS_LOW_WATER  75
+
 // default: 16x 4096 bytes, now 128x 16k (2M)
 #define OMX_AUDIO_BUFFERS 128
 #define OMX_AUDIO_BUFFERSIZE KILOBYTE(16);
 
+// minimum interval in ms between two STC queries to the clock component, the
+// STC is extrapolated in between, or while the clock has not started yet
+#define OMX_STC_REFRESH_MS         100
+#define OMX_STC_REFRESH_STOPPED_MS 20
+
+// worst case deviation in ppm between the extrapolated STC and the clock
+// component, caused by latency target and live speed adjustments
+#define OMX_STC_MAX_DRIFT_PPM 2000
+
+// time in ms the active stream needs to be rendering before the standby
+// video decoder's buffers are allocated
+#define OMX_STANDBY_PREPARE_DELAY 3000
+
 #define OMX_INIT_STRUCT(a) \
 	memset(&(a), 0, sizeof(a)); \
 	(a).nSize = sizeof(a); \
@@ -130,6 +151,11 @@ public:
 		m_signal->Signal();
 	}
 
+	bool Wait(int timeoutMs)
+	{
+		return m_signal->Wait(timeoutMs);
+	}
+
 private:
 
 	cOmxEvents(const cOmxEvents&);
@@ -235,11 +261,15 @@ void cOmx::Action(void)
 
 			delete event;
 		}
-		cCondWait::SleepMs(10);
+		m_portEvents->Wait(10);
+
+		if (m_prepareStandbyVideoCodec != cVideoCodec::eInvalid)
+			PrepareStandbyVideoDecoder();
 
 		if (timer.TimedOut())
 		{
 			timer.Set(100);
+			cRpiZapStat::Poll();
 			Lock();
 			for (int i = BUFFERSTAT_FILTER_SIZE - 1; i > 0; i--)
 			{
@@ -253,7 +283,15 @@ void cOmx::Action(void)
 
 bool cOmx::PollVideo(void)
 {
-	return (m_usedVideoBuffers[0] * 100 / OMX_VIDEO_BUFFERS) < 90;
+	return !VideoBuffersFull();
+}
+
+bool cOmx::WaitForVideoBuffers(int timeoutMs)
+{
+	if (VideoBuffersFull() && timeoutMs > 0)
+		m_videoBuffersAvailable->Wait(timeoutMs);
+
+	return !VideoBuffersFull();
 }
 
 void cOmx::GetBufferUsage(int &audio, int &video)
@@ -277,10 +315,21 @@ void cOmx::HandlePortBufferEmptied(eOmxComponent component)
 	{
 	case eVideoDecoder:
 		m_usedVideoBuffers[0]--;
+		if (VideoBuffersFull() && (m_usedVideoBuffers[0] * 100 /
+				OMX_VIDEO_BUFFERS) < OMX_VIDEO_BUFFERS_LOW_WATER)
+		{
+			SetVideoBuffersFull(false);
+			m_videoBuffersAvailable->Signal();
+		}
 		break;
 
 	case eAudioRender:
 		m_usedAudioBuffers[0]--;
+		cRpiZapStat::Mark(cRpiZapStat::eFirstAudioEmptied);
+		break;
+
+	case eStandbyVideoDecoder:
+		// late buffer of a decoder which has been put into standby
 		break;
 
 	default:
@@ -305,6 +354,8 @@ void cOmx::HandlePortSettingsChanged(unsigned int portId)
 		break;
 
 	case 131:
+		cRpiZapStat::Mark(cRpiZapStat::eVideoFormat);
+
 		OMX_PARAM_PORTDEFINITIONTYPE portdef;
 		OMX_INIT_STRUCT(portdef);
 		portdef.nPortIndex = 131;
@@ -410,6 +461,9 @@ void cOmx::HandlePortSettingsChanged(unsigned int portId)
 			ELOG("failed to setup up tunnel from scheduler to render!");
 		if (ilclient_change_component_state(m_comp[eVideoRender], OMX_StateExecuting) != 0)
 			ELOG("failed to enable video render!");
+
+		cRpiZapStat::Mark(cRpiZapStat::eRenderTunnel);
+		m_videoRenderingSince = cTimeMs::Now();
 		break;
 	}
 
@@ -419,11 +473,22 @@ void cOmx::HandlePortSettingsChanged(unsigned int portId)
 void cOmx::OnBufferEmpty(void *instance, COMPONENT_T *comp)
 {
 	cOmx* omx = static_cast <cOmx*> (instance);
+
+	omx->m_compMutex->Lock();
+	eOmxComponent component =
+			comp == omx->m_comp[eVideoDecoder] ? eVideoDecoder :
+			comp == omx->m_comp[eAudioRender] ? eAudioRender :
+			comp == omx->m_comp[eStandbyVideoDecoder] ?
+					eStandbyVideoDecoder : eInvalidComponent;
+	omx->m_compMutex->Unlock();
+
+	if (component == eVideoDecoder)
+		cRpiBufferTrace::Add(cRpiBufferTrace::eVideo, cRpiBufferTrace::eEmptied);
+	else if (component == eAudioRender)
+		cRpiBufferTrace::Add(cRpiBufferTrace::eAudio, cRpiBufferTrace::eEmptied);
+
 	omx->m_portEvents->Add(
-			new cOmxEvents::Event(cOmxEvents::eBufferEmptied,
-					comp == omx->m_comp[eVideoDecoder] ? eVideoDecoder :
-					comp == omx->m_comp[eAudioRender] ? eAudioRender :
-							eInvalidComponent));
+			new cOmxEvents::Event(cOmxEvents::eBufferEmptied, component));
 }
 
 void cOmx::OnPortSettingsChanged(void *instance, COMPONENT_T *comp, OMX_U32 data)
@@ -456,13 +521,25 @@ void cOmx::OnError(void *instance, COMPONENT_T *comp, OMX_U32 data)
 cOmx::cOmx() :
 	cThread(),
 	m_client(NULL),
+	m_compMutex(new cMutex()),
 	m_setAudioStartTime(false),
 	m_setVideoStartTime(false),
 	m_setVideoDiscontinuity(false),
+	m_videoCodec(cVideoCodec::eInvalid),
+	m_lastVideoCodec(cVideoCodec::eInvalid),
+	m_standbyVideoCodec(cVideoCodec::eInvalid),
+	m_prepareStandbyVideoCodec(cVideoCodec::eInvalid),
+	m_videoRenderingSince(0),
 	m_spareAudioBuffers(0),
 	m_spareVideoBuffers(0),
+	m_videoBuffersFull(0),
+	m_videoBuffersAvailable(new cCondWait()),
 	m_clockReference(eClockRefNone),
 	m_clockScale(0),
+	m_stcMutex(new cMutex()),
+	m_stc(OMX_INVALID_PTS),
+	m_stcTime(0),
+	m_stcRunning(false),
 	m_portEvents(new cOmxEvents()),
 	m_handlePortEvents(false),
 	m_onBufferStall(0),
@@ -484,6 +561,9 @@ cOmx::cOmx() :
 cOmx::~cOmx()
 {
 	delete m_portEvents;
+	delete m_videoBuffersAvailable;
+	delete m_stcMutex;
+	delete m_compMutex;
 }
 
 int cOmx::Init(int display, int layer)
@@ -507,6 +587,13 @@ int cOmx::Init(int display, int layer)
 		(ILCLIENT_DISABLE_ALL_PORTS | ILCLIENT_ENABLE_INPUT_BUFFERS)) != 0)
 		ELOG("failed creating video decoder!");
 
+	// create a second video_decode, which is kept configured for another
+	// codec than the active one to speed up switching between codecs
+	if (ilclient_create_component(m_client, &m_comp[eStandbyVideoDecoder],
+		"video_decode",	(ILCLIENT_CREATE_FLAGS_T)
+		(ILCLIENT_DISABLE_ALL_PORTS | ILCLIENT_ENABLE_INPUT_BUFFERS)) != 0)
+		ELOG("failed creating standby video decoder!");
+
 	// create image_fx
 	if (ilclient_create_component(m_client, &m_comp[eVideoFx],
 		"image_fx",	ILCLIENT_DISABLE_ALL_PORTS) != 0)
@@ -558,13 +645,16 @@ int cOmx::Init(int display, int layer)
 
 	ilclient_change_component_state(m_comp[eClock], OMX_StateExecuting);
 	ilclient_change_component_state(m_comp[eVideoDecoder], OMX_StateIdle);
+	ilclient_change_component_state(m_comp[eStandbyVideoDecoder], OMX_StateIdle);
 	ilclient_change_component_state(m_comp[eVideoFx], OMX_StateIdle);
 	ilclient_change_component_state(m_comp[eAudioRender], OMX_StateIdle);
 
 	SetDisplay(display, layer);
 	SetClockLatencyTarget();
 	SetPARChangeCallback(true);
+	SetPARChangeCallback(true, eStandbyVideoDecoder);
 	SetBufferStallThreshold(20000);
+	SetBufferStallThreshold(20000, eStandbyVideoDecoder);
 	SetClockReference(cOmx::eClockRefVideo);
 
 	FlushVideo();
@@ -580,6 +670,10 @@ int cOmx::DeInit(void)
 	Cancel(-1);
 	m_portEvents->Add(0);
 
+	if (m_standbyVideoCodec != cVideoCodec::eInvalid)
+		ilclient_disable_port_buffers(m_comp[eStandbyVideoDecoder], 130,
+				NULL, NULL, NULL);
+
 	for (int i = 0; i < eNumTunnels; i++)
 		ilclient_disable_tunnel(&m_tun[i]);
 
@@ -645,6 +739,59 @@ int64_t cOmx::TicksToPts(OMX_TICKS &ticks)
 }
 
 int64_t cOmx::GetSTC(void)
+{
+	m_stcMutex->Lock();
+	uint64_t now = cTimeUs::Now();
+
+	if (!m_stcTime || now - m_stcTime >= 1000 * (uint64_t)(m_stcRunning ?
+			OMX_STC_REFRESH_MS : OMX_STC_REFRESH_STOPPED_MS))
+	{
+		int64_t stc = QuerySTC();
+		if (stc != OMX_INVALID_PTS)
+		{
+			// only extrapolate if the clock actually has been running
+			// between the last two queries
+			m_stcRunning = m_stcTime && stc != m_stc;
+			m_stc = stc;
+			m_stcTime = now;
+		}
+		else
+			m_stcTime = 0;
+	}
+
+	int64_t stc = m_stc;
+	if (m_stcTime && m_stcRunning)
+		stc += (int64_t)(now - m_stcTime) * 9 * m_clockScale / 100 / 0x10000;
+
+	m_stcMutex->Unlock();
+	return m_stcTime ? stc : OMX_INVALID_PTS;
+}
+
+int64_t cOmx::GetSTCAccuracy(void)
+{
+	// returns the maximum deviation in PTS ticks of the STC returned by
+	// GetSTC() from the actual clock component's media time
+	m_stcMutex->Lock();
+	int64_t ret = 0;
+	if (m_stcTime)
+	{
+		int64_t age = cTimeUs::Now() - m_stcTime;
+		ret = m_stcRunning ? age * 9 * OMX_STC_MAX_DRIFT_PPM / 100000000 :
+				age * 9 / 100;
+	}
+	m_stcMutex->Unlock();
+	return ret;
+}
+
+void cOmx::InvalidateSTC(void)
+{
+	m_stcMutex->Lock();
+	m_stcTime = 0;
+	m_stcRunning = false;
+	m_stcMutex->Unlock();
+}
+
+int64_t cOmx::QuerySTC(void)
 {
 	int64_t stc = OMX_INVALID_PTS;
 	OMX_TIME_CONFIG_TIMESTAMPTYPE timestamp;
@@ -703,6 +850,9 @@ void cOmx::StartClock(bool waitForVideo, bool waitForAudio, int preRollMs)
 	if (OMX_SetConfig(ILC_GET_HANDLE(m_comp[eClock]),
 			OMX_IndexConfigTimeClockState, &cstate) != OMX_ErrorNone)
 		ELOG("failed to start clock!");
+
+	InvalidateSTC();
+	cRpiZapStat::Mark(cRpiZapStat::eStartClock);
 }
 
 void cOmx::StopClock(void)
@@ -715,6 +865,8 @@ void cOmx::StopClock(void)
 	if (OMX_SetConfig(ILC_GET_HANDLE(m_comp[eClock]),
 			OMX_IndexConfigTimeClockState, &cstate) != OMX_ErrorNone)
 		ELOG("failed to stop clock!");
+
+	InvalidateSTC();
 }
 
 void cOmx::SetClockScale(OMX_S32 scale)
@@ -730,6 +882,8 @@ void cOmx::SetClockScale(OMX_S32 scale)
 			ELOG("failed to set clock scale (%d)!", scale);
 		else
 			m_clockScale = scale;
+
+		InvalidateSTC();
 	}
 }
 
@@ -755,6 +909,8 @@ void cOmx::ResetClock(void)
 				!= OMX_ErrorNone)
 			ELOG("failed to set current video reference time!");
 	}
+
+	InvalidateSTC();
 }
 
 unsigned int cOmx::GetAudioLatency(void)
@@ -833,19 +989,19 @@ void cOmx::SetClockLatencyTarget(void)
 		ELOG("failed set video render latency target!");
 }
 
-void cOmx::SetPARChangeCallback(bool enable)
+void cOmx::SetPARChangeCallback(bool enable, eOmxComponent decoder)
 {
 	OMX_CONFIG_REQUESTCALLBACKTYPE reqCallback;
 	OMX_INIT_STRUCT(reqCallback);
 	reqCallback.nPortIndex = 131;
 	reqCallback.bEnable = enable ? OMX_TRUE : OMX_FALSE;
 	reqCallback.nIndex = OMX_IndexParamBrcmPixelAspectRatio;
-	if (OMX_SetConfig(ILC_GET_HANDLE(m_comp[eVideoDecoder]),
+	if (OMX_SetConfig(ILC_GET_HANDLE(m_comp[decoder]),
 			OMX_IndexConfigRequestCallback, &reqCallback) != OMX_ErrorNone)
 		ELOG("failed to set video aspect ratio change call back!");
 }
 
-void cOmx::SetBufferStallThreshold(int delayMs)
+void cOmx::SetBufferStallThreshold(int delayMs, eOmxComponent decoder)
 {
 	if (delayMs > 0)
 	{
@@ -853,7 +1009,7 @@ void cOmx::SetBufferStallThreshold(int delayMs)
 		OMX_INIT_STRUCT(stallConf);
 		stallConf.nPortIndex = 131;
 		stallConf.nDelay = delayMs * 1000;
-		if (OMX_SetConfig(ILC_GET_HANDLE(m_comp[eVideoDecoder]),
+		if (OMX_SetConfig(ILC_GET_HANDLE(m_comp[decoder]),
 				OMX_IndexConfigBufferStall, &stallConf) != OMX_ErrorNone)
 			ELOG("failed to set video decoder stall config!");
 	}
@@ -864,7 +1020,7 @@ void cOmx::SetBufferStallThreshold(int delayMs)
 	reqCallback.nPortIndex = 131;
 	reqCallback.nIndex = OMX_IndexConfigBufferStall;
 	reqCallback.bEnable = delayMs > 0 ? OMX_TRUE : OMX_FALSE;
-	if (OMX_SetConfig(ILC_GET_HANDLE(m_comp[eVideoDecoder]),
+	if (OMX_SetConfig(ILC_GET_HANDLE(m_comp[decoder]),
 			OMX_IndexConfigRequestCallback, &reqCallback) != OMX_ErrorNone)
 		ELOG("failed to set video decoder stall call back!");
 }
@@ -916,6 +1072,11 @@ void cOmx::StopVideo(void)
 
 	m_spareVideoBuffers = 0;
 	m_handlePortEvents = false;
+	m_videoCodec = cVideoCodec::eInvalid;
+	m_videoRenderingSince = 0;
+
+	SetVideoBuffersFull(false);
+	m_videoBuffersAvailable->Signal();
 
 	m_videoFrameFormat.width = 0;
 	m_videoFrameFormat.height = 0;
@@ -960,14 +1121,15 @@ void cOmx::StopAudio(void)
 	Unlock();
 }
 
-void cOmx::SetVideoErrorConcealment(bool startWithValidFrame)
+void cOmx::SetVideoErrorConcealment(bool startWithValidFrame,
+		eOmxComponent decoder)
 {
 	OMX_PARAM_BRCMVIDEODECODEERRORCONCEALMENTTYPE ectype;
 	OMX_INIT_STRUCT(ectype);
 	ectype.bStartWithValidFrame = startWithValidFrame ? OMX_TRUE : OMX_FALSE;
-	if (OMX_SetParameter(ILC_GET_HANDLE(m_comp[eVideoDecoder]),
+	if (OMX_SetParameter(ILC_GET_HANDLE(m_comp[decoder]),
 			OMX_IndexParamBrcmVideoDecodeErrorConcealment, &ectype) != OMX_ErrorNone)
-		ELOG("failed to set video decode error concealment failed\n");
+		ELOG("failed to set video decode error concealment!");
 }
 
 void cOmx::FlushAudio(void)
@@ -1011,8 +1173,70 @@ void cOmx::FlushVideo(bool flushRender)
 int cOmx::SetVideoCodec(cVideoCodec::eCodec codec)
 {
 	Lock();
+	cTimeMs timer;
+
+	// use standby decoder if it has already been set up for this codec
+	bool standby = codec != cVideoCodec::eInvalid &&
+			codec == m_standbyVideoCodec && codec != m_videoCodec;
+
+	if (standby)
+	{
+		SwapVideoDecoders();
+
+		// it's been prepared with the minimum number of buffers only
+		ilclient_disable_port_buffers(m_comp[eVideoDecoder], 130,
+				NULL, NULL, NULL);
+		EnableVideoDecoderBuffers(eVideoDecoder, OMX_VIDEO_BUFFERS);
+	}
+	else
+		ConfigureVideoDecoder(eVideoDecoder, codec);
+
+	// record zap time of codec changes to tell what the standby decoder saves
+	if (codec != cVideoCodec::eInvalid)
+	{
+		if (m_lastVideoCodec != cVideoCodec::eInvalid &&
+				codec != m_lastVideoCodec)
+			cRpiZapStat::CodecChange(standby);
+		m_lastVideoCodec = codec;
+	}
+
+	m_videoCodec = codec;
+
+	for (int i = 0; i < BUFFERSTAT_FILTER_SIZE; i++)
+		m_usedVideoBuffers[i] = 0;
+
+	SetVideoBuffersFull(false);
+	m_videoBuffersAvailable->Signal();
+
+	if (ilclient_change_component_state(m_comp[eVideoDecoder], OMX_StateExecuting) != 0)
+		ELOG("failed to set video decoder to executing state!");
+
+	// setup clock tunnels first
+	if (ilclient_setup_tunnel(&m_tun[eClockToVideoScheduler], 0, 0) != 0)
+		ELOG("failed to setup up tunnel from clock to video scheduler!");
 
-	if (ilclient_change_component_state(m_comp[eVideoDecoder], OMX_StateIdle) != 0)
+	m_handlePortEvents = true;
+
+	// keep standby decoder prepared for the other codec
+	cVideoCodec::eCodec other =
+			codec == cVideoCodec::eMPEG2 ? cVideoCodec::eH264 :
+			codec == cVideoCodec::eH264  ? cVideoCodec::eMPEG2 :
+					cVideoCodec::eInvalid;
+
+	if (other != m_standbyVideoCodec && cRpiSetup::IsVideoCodecSupported(other))
+		m_prepareStandbyVideoCodec = other;
+
+	DBG("SetVideoCodec(%s) took %dms%s", cVideoCodec::Str(codec),
+			(int)timer.Elapsed(), standby ? " (standby decoder)" : "");
+
+	Unlock();
+	return 0;
+}
+
+bool cOmx::ConfigureVideoDecoder(eOmxComponent decoder,
+		cVideoCodec::eCodec codec)
+{
+	if (ilclient_change_component_state(m_comp[decoder], OMX_StateIdle) != 0)
 		ELOG("failed to set video decoder to idle state!");
 
 	// configure video decoder
@@ -1024,47 +1248,107 @@ int cOmx::SetVideoCodec(cVideoCodec::eCodec codec)
 			codec == cVideoCodec::eH264  ? OMX_VIDEO_CodingAVC   :
 					OMX_VIDEO_CodingAutoDetect;
 
-	if (OMX_SetParameter(ILC_GET_HANDLE(m_comp[eVideoDecoder]),
+	if (OMX_SetParameter(ILC_GET_HANDLE(m_comp[decoder]),
 			OMX_IndexParamVideoPortFormat, &videoFormat) != OMX_ErrorNone)
 		ELOG("failed to set video decoder parameters!");
 
+	// start with valid frames only if codec is MPEG2
+	// update: with FW from 2015/01/18 this is not necessary anymore
+	SetVideoErrorConcealment(true, decoder);
+
+	// update: with FW from 2014/02/04 this is not necessary anymore
+	//SetVideoDecoderExtraBuffers(3);
+
+	// the standby decoder only gets the minimum number of buffers, the full
+	// set is allocated once it's swapped in
+	return EnableVideoDecoderBuffers(decoder,
+			decoder == eStandbyVideoDecoder ? 0 : OMX_VIDEO_BUFFERS);
+}
+
+bool cOmx::EnableVideoDecoderBuffers(eOmxComponent decoder, int buffers)
+{
 	OMX_PARAM_PORTDEFINITIONTYPE param;
 	OMX_INIT_STRUCT(param);
 	param.nPortIndex = 130;
-	if (OMX_GetParameter(ILC_GET_HANDLE(m_comp[eVideoDecoder]),
+	if (OMX_GetParameter(ILC_GET_HANDLE(m_comp[decoder]),
 			OMX_IndexParamPortDefinition, &param) != OMX_ErrorNone)
 		ELOG("failed to get video decoder port parameters!");
 
 	param.nBufferSize = OMX_VIDEO_BUFFERSIZE;
-	param.nBufferCountActual = OMX_VIDEO_BUFFERS;
-	for (int i = 0; i < BUFFERSTAT_FILTER_SIZE; i++)
-		m_usedVideoBuffers[i] = 0;
+	param.nBufferCountActual = buffers ? buffers : param.nBufferCountMin;
 
-	if (OMX_SetParameter(ILC_GET_HANDLE(m_comp[eVideoDecoder]),
+	if (OMX_SetParameter(ILC_GET_HANDLE(m_comp[decoder]),
 			OMX_IndexParamPortDefinition, &param) != OMX_ErrorNone)
 		ELOG("failed to set video decoder port parameters!");
 
-	// start with valid frames only if codec is MPEG2
-	// update: with FW from 2015/01/18 this is not necessary anymore
-	SetVideoErrorConcealment(true /*codec == cVideoCodec::eMPEG2*/);
+	if (ilclient_enable_port_buffers(m_comp[decoder], 130, NULL, NULL, NULL) != 0)
+	{
+		ELOG("failed to enable port buffer on video decoder!");
+		return false;
+	}
+	return true;
+}
 
-	// update: with FW from 2014/02/04 this is not necessary anymore
-	//SetVideoDecoderExtraBuffers(3);
+void cOmx::SwapVideoDecoders(void)
+{
+	// the active decoder has been stopped before, so its input port is
+	// disabled and it needs to be configured again before being used
+	m_compMutex->Lock();
+	COMPONENT_T *comp = m_comp[eVideoDecoder];
+	m_comp[eVideoDecoder] = m_comp[eStandbyVideoDecoder];
+	m_comp[eStandbyVideoDecoder] = comp;
+	m_compMutex->Unlock();
+	m_standbyVideoCodec = cVideoCodec::eInvalid;
 
-	if (ilclient_enable_port_buffers(m_comp[eVideoDecoder], 130, NULL, NULL, NULL) != 0)
-		ELOG("failed to enable port buffer on video decoder!");
+	set_tunnel(&m_tun[eVideoDecoderToVideoFx],
+		m_comp[eVideoDecoder], 131, m_comp[eVideoFx], 190);
+}
 
-	if (ilclient_change_component_state(m_comp[eVideoDecoder], OMX_StateExecuting) != 0)
-		ELOG("failed to set video decoder to executing state!");
+void cOmx::PrepareStandbyVideoDecoder(void)
+{
+	// wait with the buffer allocation until the active stream has been
+	// rendering for a while, so it doesn't compete with the stream start
+	Lock();
+	cVideoCodec::eCodec codec = m_prepareStandbyVideoCodec;
+	if (!m_videoRenderingSince || cTimeMs::Now() - m_videoRenderingSince <
+			OMX_STANDBY_PREPARE_DELAY)
+	{
+		Unlock();
+		return;
+	}
+	m_prepareStandbyVideoCodec = cVideoCodec::eInvalid;
 
-	// setup clock tunnels first
-	if (ilclient_setup_tunnel(&m_tun[eClockToVideoScheduler], 0, 0) != 0)
-		ELOG("failed to setup up tunnel from clock to video scheduler!");
+	if (codec == cVideoCodec::eInvalid || codec == m_standbyVideoCodec)
+	{
+		Unlock();
+		return;
+	}
 
-	m_handlePortEvents = true;
+	// the standby decoder won't be swapped in while it's not set up for any
+	// codec, so it can be configured without holding the lock, which would
+	// block feeding the active decoder
+	bool configured = m_standbyVideoCodec != cVideoCodec::eInvalid;
+	m_standbyVideoCodec = cVideoCodec::eInvalid;
+	Unlock();
+
+	if (configured)
+		ilclient_disable_port_buffers(m_comp[eStandbyVideoDecoder], 130,
+				NULL, NULL, NULL);
+
+	cTimeMs timer;
+	if (!ConfigureVideoDecoder(eStandbyVideoDecoder, codec))
+	{
+		ELOG("failed to prepare standby video decoder for %s!",
+				cVideoCodec::Str(codec));
+		return;
+	}
 
+	Lock();
+	m_standbyVideoCodec = codec;
 	Unlock();
-	return 0;
+
+	DBG("prepared standby video decoder for %s in %dms",
+			cVideoCodec::Str(codec), (int)timer.Elapsed());
 }
 
 void cOmx::SetVideoDecoderExtraBuffers(int extraBuffers)
@@ -1321,6 +1605,8 @@ OMX_BUFFERHEADERTYPE* cOmx::GetAudioBuffer(int64_t pts)
 			m_setAudioStartTime = false;
 		}
 		cOmx::PtsToTicks(pts, buf->nTimeStamp);
+		cRpiBufferTrace::Add(cRpiBufferTrace::eAudio, cRpiBufferTrace::eGet,
+				FromOmxTicks(buf->nTimeStamp), buf->nFlags);
 	}
 	Unlock();
 	return buf;
@@ -1341,7 +1627,12 @@ OMX_BUFFERHEADERTYPE* cOmx::GetVideoBuffer(int64_t pts)
 	{
 		buf = ilclient_get_input_buffer(m_comp[eVideoDecoder], 130, 0);
 		if (buf)
+		{
 			m_usedVideoBuffers[0]++;
+			if ((m_usedVideoBuffers[0] * 100 / OMX_VIDEO_BUFFERS) >=
+					OMX_VIDEO_BUFFERS_HIGH_WATER)
+				SetVideoBuffersFull(true);
+		}
 	}
 
 	if (buf)
@@ -1363,38 +1654,13 @@ OMX_BUFFERHEADERTYPE* cOmx::GetVideoBuffer(int64_t pts)
 			m_setVideoDiscontinuity = false;
 		}
 		cOmx::PtsToTicks(pts, buf->nTimeStamp);
+		cRpiBufferTrace::Add(cRpiBufferTrace::eVideo, cRpiBufferTrace::eGet,
+				FromOmxTicks(buf->nTimeStamp), buf->nFlags);
 	}
 	Unlock();
 	return buf;
 }
 
-#ifdef DEBUG_BUFFERS
-void cOmx::DumpBuffer(OMX_BUFFERHEADERTYPE *buf, const char *prefix)
-{
-	DLOG("%s: TS=%8x%08x, LEN=%5d/%5d: %02x %02x %02x %02x... "
-			"FLAGS: %s%s%s%s%s%s%s%s%s%s%s%s%s%s",
-		prefix,
-		buf->nTimeStamp.nHighPart, buf->nTimeStamp.nLowPart,
-		buf->nFilledLen, buf->nAllocLen,
-		buf->pBuffer[0], buf->pBuffer[1], buf->pBuffer[2], buf->pBuffer[3],
-		buf->nFlags & OMX_BUFFERFLAG_EOS             ? "EOS "           : "",
-		buf->nFlags & OMX_BUFFERFLAG_STARTTIME       ? "STARTTIME "     : "",
-		buf->nFlags & OMX_BUFFERFLAG_DECODEONLY      ? "DECODEONLY "    : "",
-		buf->nFlags & OMX_BUFFERFLAG_DATACORRUPT     ? "DATACORRUPT "   : "",
-		buf->nFlags & OMX_BUFFERFLAG_ENDOFFRAME      ? "ENDOFFRAME "    : "",
-		buf->nFlags & OMX_BUFFERFLAG_SYNCFRAME       ? "SYNCFRAME "     : "",
-		buf->nFlags & OMX_BUFFERFLAG_EXTRADATA       ? "EXTRADATA "     : "",
-		buf->nFlags & OMX_BUFFERFLAG_CODECCONFIG     ? "CODECCONFIG "   : "",
-		buf->nFlags & OMX_BUFFERFLAG_TIME_UNKNOWN    ? "TIME_UNKNOWN "  : "",
-		buf->nFlags & OMX_BUFFERFLAG_CAPTURE_PREVIEW ? "CAPTURE_PREV "  : "",
-		buf->nFlags & OMX_BUFFERFLAG_ENDOFNAL        ? "ENDOFNAL "      : "",
-		buf->nFlags & OMX_BUFFERFLAG_FRAGMENTLIST    ? "FRAGMENTLIST "  : "",
-		buf->nFlags & OMX_BUFFERFLAG_DISCONTINUITY   ? "DISCONTINUITY " : "",
-		buf->nFlags & OMX_BUFFERFLAG_CODECSIDEINFO   ? "CODECSIDEINFO " : ""
-	);
-}
-#endif
-
 bool cOmx::EmptyAudioBuffer(OMX_BUFFERHEADERTYPE *buf)
 {
 	if (!buf)
@@ -1402,14 +1668,14 @@ bool cOmx::EmptyAudioBuffer(OMX_BUFFERHEADERTYPE *buf)
 
 	Lock();
 	bool ret = true;
-#ifdef DEBUG_BUFFERS
-	DumpBuffer(buf, "A");
-#endif
+	cRpiBufferTrace::Add(cRpiBufferTrace::eAudio, cRpiBufferTrace::eEmpty,
+			FromOmxTicks(buf->nTimeStamp), buf->nFlags, buf->nFilledLen);
 
 	if (OMX_EmptyThisBuffer(ILC_GET_HANDLE(m_comp[eAudioRender]), buf)
 			!= OMX_ErrorNone)
 	{
 		ELOG("failed to empty OMX audio buffer");
+		cRpiBufferTrace::Revoke(cRpiBufferTrace::eAudio);
 
 		if (buf->nFlags & OMX_BUFFERFLAG_STARTTIME)
 			m_setAudioStartTime = true;
@@ -1433,14 +1699,14 @@ bool cOmx::EmptyVideoBuffer(OMX_BUFFERHEADERTYPE *buf)
 
 	Lock();
 	bool ret = true;
-#ifdef DEBUG_BUFFERS
-	DumpBuffer(buf, "V");
-#endif
+	cRpiBufferTrace::Add(cRpiBufferTrace::eVideo, cRpiBufferTrace::eEmpty,
+			FromOmxTicks(buf->nTimeStamp), buf->nFlags, buf->nFilledLen);
 
 	if (OMX_EmptyThisBuffer(ILC_GET_HANDLE(m_comp[eVideoDecoder]), buf)
 			!= OMX_ErrorNone)
 	{
 		ELOG("failed to empty OMX video buffer");
+		cRpiBufferTrace::Revoke(cRpiBufferTrace::eVideo);
 
 		if (buf->nFlags & OMX_BUFFERFLAG_STARTTIME)
 			m_setVideoStartTime = true;
@@ -1453,3 +1719,22 @@ bool cOmx::EmptyVideoBuffer(OMX_BUFFERHEADERTYPE *buf)
 	Unlock();
 	return ret;
 }
+
+void cOmx::ReleaseVideoBuffer(OMX_BUFFERHEADERTYPE *buf)
+{
+	if (!buf)
+		return;
+
+	// return a buffer got by GetVideoBuffer() without passing it to OMX
+	Lock();
+	if (buf->nFlags & OMX_BUFFERFLAG_STARTTIME)
+		m_setVideoStartTime = true;
+
+	if (buf->nFlags & OMX_BUFFERFLAG_DISCONTINUITY)
+		m_setVideoDiscontinuity = true;
+
+	buf->nFilledLen = 0;
+	buf->pAppPrivate = m_spareVideoBuffers;
+	m_spareVideoBuffers = buf;
+	Unlock();
+}
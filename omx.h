@@ -52,6 +52,7 @@ public:
 	static int64_t TicksToPts(OMX_TICKS &ticks);
 
 	int64_t GetSTC(void);
+	int64_t GetSTCAccuracy(void);
 	bool IsClockRunning(void);
 
 	enum eClockState {
@@ -84,7 +85,6 @@ public:
 	void StopVideo(void);
 	void StopAudio(void);
 
-	void SetVideoErrorConcealment(bool startWithValidFrame);
 	void SetVideoDecoderExtraBuffers(int extraBuffers);
 
 	void FlushAudio(void);
@@ -108,10 +108,13 @@ public:
 	OMX_BUFFERHEADERTYPE* GetVideoBuffer(int64_t pts = OMX_INVALID_PTS);
 
 	bool PollVideo(void);
+	bool WaitForVideoBuffers(int timeoutMs);
 
 	bool EmptyAudioBuffer(OMX_BUFFERHEADERTYPE *buf);
 	bool EmptyVideoBuffer(OMX_BUFFERHEADERTYPE *buf);
 
+	void ReleaseVideoBuffer(OMX_BUFFERHEADERTYPE *buf);
+
 	void GetBufferUsage(int &audio, int &video);
 
 private:
@@ -120,10 +123,6 @@ private:
 
 	static const char* errStr(int err);
 
-#ifdef DEBUG_BUFFERS
-	static void DumpBuffer(OMX_BUFFERHEADERTYPE *buf, const char *prefix = "");
-#endif
-
 	enum eOmxComponent {
 		eClock = 0,
 		eVideoDecoder,
@@ -131,6 +130,7 @@ private:
 		eVideoScheduler,
 		eVideoRender,
 		eAudioRender,
+		eStandbyVideoDecoder,
 		eNumComponents,
 		eInvalidComponent
 	};
@@ -146,10 +146,20 @@ private:
 
 	ILCLIENT_T 	*m_client;
 	COMPONENT_T	*m_comp[cOmx::eNumComponents + 1];
+
+	// guards swapping the video decoders against the buffer callback, which
+	// can't take the main lock, since it's held while waiting for OMX
+	cMutex      *m_compMutex;
 	TUNNEL_T 	 m_tun[cOmx::eNumTunnels + 1];
 
 	cVideoFrameFormat m_videoFrameFormat;
 
+	cVideoCodec::eCodec m_videoCodec;
+	cVideoCodec::eCodec m_lastVideoCodec;
+	cVideoCodec::eCodec m_standbyVideoCodec;
+	cVideoCodec::eCodec m_prepareStandbyVideoCodec;
+	uint64_t            m_videoRenderingSince;
+
 	bool m_setAudioStartTime;
 	bool m_setVideoStartTime;
 	bool m_setVideoDiscontinuity;
@@ -159,12 +169,34 @@ private:
 	int m_usedAudioBuffers[BUFFERSTAT_FILTER_SIZE];
 	int m_usedVideoBuffers[BUFFERSTAT_FILTER_SIZE];
 
+	// written with the lock held, but read without it by the player thread
+	void SetVideoBuffersFull(bool full) {
+		if (full)
+			__sync_fetch_and_or(&m_videoBuffersFull, 1);
+		else
+			__sync_fetch_and_and(&m_videoBuffersFull, 0);
+	}
+	bool VideoBuffersFull(void) {
+		return __sync_fetch_and_or(&m_videoBuffersFull, 0);
+	}
+
+	volatile int m_videoBuffersFull;
+	cCondWait *m_videoBuffersAvailable;
+
 	OMX_BUFFERHEADERTYPE* m_spareAudioBuffers;
 	OMX_BUFFERHEADERTYPE* m_spareVideoBuffers;
 
 	eClockReference	m_clockReference;
 	OMX_S32 m_clockScale;
 
+	cMutex  *m_stcMutex;
+	int64_t  m_stc;
+	uint64_t m_stcTime;
+	bool     m_stcRunning;
+
+	int64_t QuerySTC(void);
+	void InvalidateSTC(void);
+
 	cOmxEvents *m_portEvents;
 	bool m_handlePortEvents;
 
@@ -179,8 +211,17 @@ private:
 
 	void HandlePortBufferEmptied(eOmxComponent component);
 	void HandlePortSettingsChanged(unsigned int portId);
-	void SetPARChangeCallback(bool enable);
-	void SetBufferStallThreshold(int delayMs);
+	void SetPARChangeCallback(bool enable,
+			eOmxComponent decoder = eVideoDecoder);
+	void SetBufferStallThreshold(int delayMs,
+			eOmxComponent decoder = eVideoDecoder);
+	void SetVideoErrorConcealment(bool startWithValidFrame,
+			eOmxComponent decoder = eVideoDecoder);
+	bool ConfigureVideoDecoder(eOmxComponent decoder,
+			cVideoCodec::eCodec codec);
+	bool EnableVideoDecoderBuffers(eOmxComponent decoder, int buffers);
+	void SwapVideoDecoders(void);
+	void PrepareStandbyVideoDecoder(void);
 	bool IsBufferStall(void);
 
 	static void OnBufferEmpty(void *instance, COMPONENT_T *comp);
@@ -23,6 +23,10 @@
 #include "display.h"
 #include "setup.h"
 #include "tools.h"
+#include "zapstat.h"
+#include "videoparser.h"
+#include "gopcache.h"
+#include "preroll.h"
 
 #include <vdr/thread.h>
 #include <vdr/remux.h>
@@ -34,21 +38,36 @@
 #define S(x) ((int)(floor(x * pow(2, 16))))
 #define PTS_START_OFFSET (32 * (MAX33BIT + 1))
 
-#define PRE_ROLL_LIVE 250
 #define PRE_ROLL_PLAYBACK 0
 
+// amount of raw still picture data used to set up the decoder
+#define STILL_PICTURE_PARSE_SIZE 1024
+
+// max. time to wait for the decoder to accept a raw still picture
+#define STILL_PICTURE_TIMEOUT 500 // ms
+
+// PTS distances between frames beyond this are considered as jump during
+// reverse playback and replaced by a typical GOP length
+#define REVERSE_MAX_PTS_DISTANCE (10 * 90000)
+#define REVERSE_DEFAULT_PTS_DISTANCE (90000 / 2)
+
+// waiting for a lock longer than this in us is counted as contention
+#define LOCKSTAT_CONTENDED 20
+
 // trick speeds as defined in vdr/dvbplayer.c
 const int cOmxDevice::s_playbackSpeeds[eNumDirections][eNumPlaybackSpeeds] = {
 	{ S(0.0f), S( 0.125f), S( 0.25f), S( 0.5f), S( 1.0f), S( 2.0f), S( 4.0f), S( 12.0f) },
 	{ S(0.0f), S(-0.125f), S(-0.25f), S(-0.5f), S(-1.0f), S(-2.0f), S(-4.0f), S(-12.0f) }
 };
 
-// speed correction factors for live mode
-// HDMI specification allows a tolerance of 1000ppm, however on the Raspberry Pi
-// it's limited to 175ppm to avoid audio drops one some A/V receivers
-const int cOmxDevice::s_liveSpeeds[eNumLiveSpeeds] = {
-	S(0.999f), S(0.99985f), S(1.000f), S(1.00015), S(1.001)
-};
+// speed correction for live mode, the controller's output is limited to the
+// clock tolerance: HDMI specification allows 1000ppm, however on the Raspberry
+// Pi it's limited to 175ppm to avoid audio drops one some A/V receivers
+#define LIVE_SPEED_INTERVAL 500  // ms
+#define LIVE_SPEED_MAX_PPM  175
+#define LIVE_SPEED_KP       1.75 // ppm per ms latency error
+#define LIVE_SPEED_TI       60   // integral time in s
+#define LIVE_SPEED_STC_ERR  2    // ms, max. error of STC to be used
 
 const uchar cOmxDevice::s_pesVideoHeader[14] = {
 	0x00, 0x00, 0x01, 0xe0, 0x00, 0x00, 0x80, 0x80, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00
@@ -62,11 +81,9 @@ cOmxDevice::cOmxDevice(void (*onPrimaryDevice)(void), int display, int layer) :
 	m_onPrimaryDevice(onPrimaryDevice),
 	m_omx(new cOmx()),
 	m_audio(new cRpiAudioDecoder(m_omx)),
-	m_mutex(new cMutex()),
 	m_timer(new cTimeMs()),
 	m_videoCodec(cVideoCodec::eInvalid),
 	m_playMode(pmNone),
-	m_liveSpeed(eNoCorrection),
 	m_playbackSpeed(eNormal),
 	m_direction(eForward),
 	m_hasVideo(false),
@@ -77,9 +94,41 @@ cOmxDevice::cOmxDevice(void (*onPrimaryDevice)(void), int display, int layer) :
 	m_audioPts(0),
 	m_videoPts(0),
 	m_lastStc(0),
+	m_liveScale(S(1.0f)),
+	m_liveLatency(-1),
+	m_liveIntegral(0),
+	m_tsVideoBuffer(0),
+	m_tsVideoPts(OMX_INVALID_PTS),
+	m_tsVideoValid(false),
+	m_tsVideoFrameStart(false),
+	m_tsVideoHeadLength(0),
+	m_dropVideo(false),
+	m_droppedVideoFrames(0),
+	m_fastVideoFrames(0),
+	m_parseVideoFormat(false),
+	m_reverseCache(
+			new cRpiGopCache(cRpiSetup::ReverseCacheSize() * 1024 * 1024)),
+	m_reversePts(OMX_INVALID_PTS),
+	m_preRoll(new cRpiPreRoll()),
+	m_preRollPending(false),
+	m_grabMutex(new cMutex()),
+	m_grabBuffer(0),
+	m_grabBufferSize(0),
+	m_grabLastUse(0),
 	m_display(display),
 	m_layer(layer)
+#ifdef DEBUG_BUFFERSTAT
+	, m_pollWakeups(0),
+	m_rejectedVideoPackets(0),
+	m_pollStatTime(cTimeMs::Now())
+#endif
 {
+	for (int i = 0; i < eNumLocks; i++)
+		m_mutex[i] = new cMutex();
+
+#ifdef DEBUG_BUFFERSTAT
+	memset(m_lockStat, 0, sizeof(m_lockStat));
+#endif
 }
 
 cOmxDevice::~cOmxDevice()
@@ -88,8 +137,13 @@ cOmxDevice::~cOmxDevice()
 
 	delete m_omx;
 	delete m_audio;
-	delete m_mutex;
+	for (int i = 0; i < eNumLocks; i++)
+		delete m_mutex[i];
 	delete m_timer;
+	delete m_reverseCache;
+	delete m_preRoll;
+	delete m_grabMutex;
+	free(m_grabBuffer);
 }
 
 int cOmxDevice::Init(void)
@@ -161,7 +215,7 @@ void cOmxDevice::ScaleVideo(const cRect &Rect)
 
 bool cOmxDevice::SetPlayMode(ePlayMode PlayMode)
 {
-	m_mutex->Lock();
+	AcquireAll();
 	DBG("SetPlayMode(%s)",
 		PlayMode == pmNone			 ? "none" 			   :
 		PlayMode == pmAudioVideo	 ? "Audio/Video" 	   :
@@ -179,12 +233,17 @@ bool cOmxDevice::SetPlayMode(ePlayMode PlayMode)
 	switch (PlayMode)
 	{
 	case pmNone:
+		ResetTsVideo();
+		ResetReverseVideo();
 		FlushStreams(true);
 		m_omx->StopVideo();
 		m_hasAudio = false;
 		m_hasVideo = false;
+		m_parseVideoFormat = false;
 		m_videoCodec = cVideoCodec::eInvalid;
 		m_playMode = pmNone;
+		m_preRoll->Start(0);
+		m_preRollPending = false;
 		break;
 
 	case pmAudioVideo:
@@ -193,13 +252,16 @@ bool cOmxDevice::SetPlayMode(ePlayMode PlayMode)
 	case pmVideoOnly:
 		m_playbackSpeed = eNormal;
 		m_direction = eForward;
+		cRpiZapStat::Start();
+		m_preRoll->Start(0);
+		m_preRollPending = Transferring();
 		break;
 
 	default:
 		break;
 	}
 
-	m_mutex->Unlock();
+	ReleaseAll();
 	return true;
 }
 
@@ -210,33 +272,36 @@ void cOmxDevice::StillPicture(const uchar *Data, int Length)
 	else
 	{
 		DBG("StillPicture()");
-		int pesLength = 0;
-		uchar *pesPacket = 0;
 
-		cVideoCodec::eCodec codec = ParseVideoCodec(Data, Length);
-		if (codec != cVideoCodec::eInvalid)
+		// some plugins deliver raw MPEG data, but a PES header is needed to
+		// set up the decoder. Instead of assembling a complete PES packet,
+		// only the header and the beginning of the data is processed, the
+		// data itself is parsed for its format and copied straight into the
+		// OMX buffers.
+		uchar pesHeader[sizeof(s_pesVideoHeader) + STILL_PICTURE_PARSE_SIZE];
+		int pesHeaderLength = 0;
+
+		bool raw = ParseVideoCodec(Data, Length) != cVideoCodec::eInvalid;
+		if (raw)
 		{
-			// some plugins deliver raw MPEG data, but PlayVideo() needs a
-			// complete PES packet with valid header
-			pesLength = Length + sizeof(s_pesVideoHeader);
-			pesPacket = MALLOC(uchar, pesLength);
-			if (!pesPacket)
-				return;
-
-			memcpy(pesPacket, s_pesVideoHeader, sizeof(s_pesVideoHeader));
-			memcpy(pesPacket + sizeof(s_pesVideoHeader), Data, Length);
-		}
-		else
-			codec = ParseVideoCodec(Data + PesPayloadOffset(Data),
-					Length - PesPayloadOffset(Data));
+			int parseLength = Length < STILL_PICTURE_PARSE_SIZE ?
+					Length : STILL_PICTURE_PARSE_SIZE;
 
-		if (codec == cVideoCodec::eInvalid)
+			memcpy(pesHeader, s_pesVideoHeader, sizeof(s_pesVideoHeader));
+			memcpy(pesHeader + sizeof(s_pesVideoHeader), Data, parseLength);
+			pesHeaderLength = sizeof(s_pesVideoHeader) + parseLength;
+		}
+		else if (ParseVideoCodec(Data + PesPayloadOffset(Data),
+				Length - PesPayloadOffset(Data)) == cVideoCodec::eInvalid)
 			return;
 
-		m_mutex->Lock();
+		AcquireAll();
+		ResetTsVideo();
+		ResetReverseVideo();
 		m_playbackSpeed = eNormal;
 		m_direction = eForward;
 		m_hasVideo = false;
+		m_parseVideoFormat = false;
 		m_omx->StopClock();
 
 		// since the stream might be interlaced, we send each frame twice, so
@@ -244,8 +309,38 @@ void cOmxDevice::StillPicture(const uchar *Data, int Length)
 		int repeat = 2;
 		while (repeat--)
 		{
-			int length = pesPacket ? pesLength : Length;
-			const uchar *data = pesPacket ? pesPacket : Data;
+			if (raw)
+			{
+				int64_t pts = ProcessVideoPesHeader(pesHeader, pesHeaderLength);
+				if (!m_hasVideo)
+					break;
+
+				ParseVideoFormat(Data, Length);
+
+				// the decoder may still be busy with data of the previous
+				// stream, so wait for buffers instead of truncating the frame
+				cTimeMs timer;
+				int submitted = 0;
+				while (!SubmitVideo(Data + submitted, Length - submitted,
+						submitted ? OMX_INVALID_PTS : pts, true, &submitted))
+				{
+					int remaining = STILL_PICTURE_TIMEOUT - (int)timer.Elapsed();
+					if (remaining <= 0)
+						break;
+
+					if (m_omx->WaitForVideoBuffers(remaining))
+						cCondWait::SleepMs(5);
+				}
+				if (submitted < Length)
+				{
+					ELOG("failed to submit still picture!");
+					break;
+				}
+				continue;
+			}
+
+			int length = Length;
+			const uchar *data = Data;
 
 			// play every single PES packet, rise ENDOFFRAME flag on last
 			while (PesLongEnough(length))
@@ -260,11 +355,9 @@ void cOmxDevice::StillPicture(const uchar *Data, int Length)
 				length -= pktLen;
 			}
 		}
-		if (pesPacket)
-			free(pesPacket);
 
 		SubmitEOS();
-		m_mutex->Unlock();
+		ReleaseAll();
 	}
 }
 
@@ -277,24 +370,24 @@ int cOmxDevice::PlayAudio(const uchar *Data, int Length, uchar Id)
 		return Length;
 	}
 
-	m_mutex->Lock();
+	Acquire(eAudioLock);
 	int ret = Length;
 	int64_t pts = PesHasPts(Data) ? PesGetPts(Data) : OMX_INVALID_PTS;
 
 	if (pts != OMX_INVALID_PTS)
 	{
+		Acquire(eStateLock);
+		StartPreRoll();
 		if (!m_hasAudio)
 		{
+			cRpiZapStat::Mark(cRpiZapStat::eFirstAudio);
 			m_hasAudio = true;
 			m_omx->SetClockReference(cOmx::eClockRefAudio);
 
 			if (!m_hasVideo)
 			{
 				DBG("audio first");
-				m_omx->SetClockScale(
-						s_playbackSpeeds[m_direction][m_playbackSpeed]);
-				m_omx->StartClock(m_hasVideo, m_hasAudio,
-						Transferring() ? PRE_ROLL_LIVE : PRE_ROLL_PLAYBACK);
+				StartClock();
 				m_audioPts = PTS_START_OFFSET + pts;
 				m_playMode = pmAudioOnly;
 			}
@@ -312,9 +405,15 @@ int cOmxDevice::PlayAudio(const uchar *Data, int Length, uchar Id)
 
 		m_audioPts += ptsDiff;
 
+		if (Transferring())
+			m_preRoll->Arrival(m_audioPts);
+
 		// keep track of direction in case of trick speed
 		if (m_trickRequest && ptsDiff)
-			PtsTracker(ptsDiff);
+			PtsTracker(ptsDiff, false);
+
+		pts = m_audioPts;
+		Release(eStateLock);
 	}
 
 	int length = Length - PesPayloadOffset(Data);
@@ -332,11 +431,10 @@ int cOmxDevice::PlayAudio(const uchar *Data, int Length, uchar Id)
 			data += 4;
 			length -= 4;
 		}
-		if (!m_audio->WriteData(data, length,
-				pts != OMX_INVALID_PTS ? m_audioPts : OMX_INVALID_PTS))
+		if (!m_audio->WriteData(data, length, pts))
 			ret = 0;
 	}
-	m_mutex->Unlock();
+	Release(eAudioLock);
 
 	if (Transferring() && !ret)
 		DBG("failed to write %d bytes of audio packet!", Length);
@@ -349,13 +447,93 @@ int cOmxDevice::PlayAudio(const uchar *Data, int Length, uchar Id)
 
 int cOmxDevice::PlayVideo(const uchar *Data, int Length, bool EndOfFrame)
 {
+	Acquire(eVideoLock);
+
 	// prevent writing incomplete frames
-	if (m_hasVideo && !m_omx->PollVideo())
+	if (m_hasVideo && !PollVideo())
+	{
+#ifdef DEBUG_BUFFERSTAT
+		m_rejectedVideoPackets++;
+#endif
+		Release(eVideoLock);
 		return 0;
+	}
 
-	m_mutex->Lock();
 	int ret = Length;
 
+	int64_t pts = ProcessVideoPesHeader(Data, Length);
+
+	if (m_hasVideo)
+		ParseVideoFormat(Data + PesPayloadOffset(Data),
+				Length - PesPayloadOffset(Data));
+
+	// frames are starting with a PES packet carrying a PTS, the following
+	// packets of the same frame share its fate
+	if (m_hasVideo && pts != OMX_INVALID_PTS)
+		m_dropVideo = DropVideoFrames() && DropVideoFrame(
+				cVideoParser::GetPictureType(m_videoCodec,
+						Data + PesPayloadOffset(Data),
+						Length - PesPayloadOffset(Data)));
+
+	if (m_hasVideo && IsReversePlayback())
+	{
+		if (!QueueReverseVideo(Data + PesPayloadOffset(Data),
+				Length - PesPayloadOffset(Data), pts))
+			ret = 0;
+	}
+
+	// skip PES header, proceed with payload towards OMX
+	else if (m_hasVideo && !m_dropVideo && !SubmitVideo(
+			Data + PesPayloadOffset(Data), Length - PesPayloadOffset(Data),
+			pts, EndOfFrame))
+		ret = 0;
+
+	Release(eVideoLock);
+
+	if (Transferring() && !ret)
+		DBG("failed to write %d bytes of video packet!", Length);
+
+	if (ret && Transferring())
+		AdjustLiveSpeed();
+
+	return ret;
+}
+
+bool cOmxDevice::SubmitVideo(const uchar *data, int length, int64_t pts,
+		bool endOfFrame, int *submitted)
+{
+	while (length > 0)
+	{
+		OMX_BUFFERHEADERTYPE *buf = m_omx->GetVideoBuffer(pts);
+		if (!buf)
+			return false;
+
+		buf->nFilledLen = buf->nAllocLen < (unsigned)length ?
+				buf->nAllocLen : length;
+
+		int filled = buf->nFilledLen;
+		memcpy(buf->pBuffer, data, filled);
+		length -= filled;
+		data += filled;
+
+		if (endOfFrame && !length)
+			buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+
+		if (!m_omx->EmptyVideoBuffer(buf))
+		{
+			ELOG("failed to pass buffer to video decoder!");
+			return false;
+		}
+		if (submitted)
+			*submitted += filled;
+
+		pts = OMX_INVALID_PTS;
+	}
+	return true;
+}
+
+int64_t cOmxDevice::ProcessVideoPesHeader(const uchar *Data, int Length)
+{
 	cVideoCodec::eCodec codec = ParseVideoCodec(Data + PesPayloadOffset(Data),
 			Length - PesPayloadOffset(Data));
 
@@ -381,14 +559,20 @@ int cOmxDevice::PlayVideo(const uchar *Data, int Length, bool EndOfFrame)
 	if (!m_hasVideo && pts != OMX_INVALID_PTS &&
 			cRpiSetup::IsVideoCodecSupported(m_videoCodec))
 	{
+		cRpiZapStat::Mark(cRpiZapStat::eFirstVideo);
+
+		// start switching the display mode while the decoder is starting up,
+		// instead of waiting for the decoder to report the format
+		m_parseVideoFormat = true;
+
+		Acquire(eStateLock);
+		StartPreRoll();
 		m_hasVideo = true;
 		if (!m_hasAudio)
 		{
 			DBG("video first");
 			m_omx->SetClockReference(cOmx::eClockRefVideo);
-			m_omx->SetClockScale(s_playbackSpeeds[m_direction][m_playbackSpeed]);
-			m_omx->StartClock(m_hasVideo, m_hasAudio,
-					Transferring() ? PRE_ROLL_LIVE : PRE_ROLL_PLAYBACK);
+			StartClock();
 			m_videoPts = PTS_START_OFFSET + pts;
 			m_playMode = pmVideoOnly;
 		}
@@ -397,63 +581,334 @@ int cOmxDevice::PlayVideo(const uchar *Data, int Length, bool EndOfFrame)
 			m_videoPts = m_audioPts + PtsDiff(m_audioPts & MAX33BIT, pts);
 			m_playMode = pmAudioVideo;
 		}
+		Release(eStateLock);
 	}
 
-	if (m_hasVideo)
+	if (m_hasVideo && pts != OMX_INVALID_PTS)
 	{
-		if (pts != OMX_INVALID_PTS)
+		Acquire(eStateLock);
+		StartPreRoll();
+		int64_t ptsDiff = PtsDiff(m_videoPts & MAX33BIT, pts);
+		m_videoPts += ptsDiff;
+
+		if (!m_hasAudio && Transferring())
+			m_preRoll->Arrival(m_videoPts);
+
+		// keep track of direction in case of trick speed
+		if (m_trickRequest && ptsDiff)
+			PtsTracker(ptsDiff, true);
+
+		pts = m_videoPts;
+		Release(eStateLock);
+		return pts;
+	}
+	return OMX_INVALID_PTS;
+}
+
+void cOmxDevice::ParseVideoFormat(const uchar *data, int length)
+{
+	// the sequence header may not be part of the first packet, so keep on
+	// trying until it has been found or the decoder reports the format
+	if (!m_parseVideoFormat)
+		return;
+
+	if (m_omx->GetVideoFrameFormat()->width)
+	{
+		m_parseVideoFormat = false;
+		return;
+	}
+
+	cVideoFrameFormat format;
+	if (cVideoParser::GetFrameFormat(m_videoCodec, data, length, format))
+	{
+		DBG("parsed video format %dx%d@%d%s, PAR=%d/%d",
+				format.width, format.height, format.frameRate,
+				format.Interlaced() ? "i" : "p",
+				format.pixelWidth, format.pixelHeight);
+
+		cRpiDisplay::SetVideoFormat(&format);
+		cRpiZapStat::Mark(cRpiZapStat::eDisplayMode);
+		m_parseVideoFormat = false;
+	}
+}
+
+int cOmxDevice::PlayTs(const uchar *Data, int Length, bool VideoOnly)
+{
+	// VDR resets its PES reassembly this way, so drop our pending data, too
+	if (!Data)
+	{
+		Acquire(eVideoLock);
+		ResetTsVideo();
+		ResetReverseVideo();
+		Release(eVideoLock);
+	}
+	return cDevice::PlayTs(Data, Length, VideoOnly);
+}
+
+int cOmxDevice::PlayTsVideo(const uchar *Data, int Length)
+{
+	// Instead of letting VDR reassemble the PES packets and copying them
+	// to OMX buffers afterwards, TS payload is copied straight into the
+	// OMX buffer. The end of a PES packet (and the frame) is only known
+	// once the next PES packet starts.
+
+	if (!TsHasPayload(Data))
+		return Length;
+
+	int offset = TsPayloadOffset(Data);
+	const uchar *payload = Data + offset;
+	int length = TS_SIZE - offset;
+
+	Acquire(eVideoLock);
+
+	if (TsPayloadStart(Data))
+	{
+		// a frame which failed to be submitted is lost, but the next one
+		// starts right here anyway
+		SubmitTsVideo(true);
+
+		// prevent writing incomplete frames, VDR will repeat this packet
+		if (m_hasVideo && !PollVideo())
+		{
+#ifdef DEBUG_BUFFERSTAT
+			m_rejectedVideoPackets++;
+#endif
+			Release(eVideoLock);
+			return 0;
+		}
+
+		m_tsVideoPts = OMX_INVALID_PTS;
+		m_tsVideoValid = false;
+		m_tsVideoFrameStart = true;
+		m_tsVideoHeadLength = 0;
+		m_dropVideo = false;
+
+		// PES header is expected to be completely in the first TS packet
+		if (length >= 9 && payload[0] == 0x00 && payload[1] == 0x00 &&
+				payload[2] == 0x01 && (payload[3] & 0xf0) == 0xe0 &&
+				PesPayloadOffset(payload) <= length)
 		{
-			int64_t ptsDiff = PtsDiff(m_videoPts & MAX33BIT, pts);
-			m_videoPts += ptsDiff;
+			m_tsVideoPts = ProcessVideoPesHeader(payload, length);
+			m_tsVideoValid = m_hasVideo;
 
-			// keep track of direction in case of trick speed
-			if (m_trickRequest && ptsDiff)
-				PtsTracker(ptsDiff);
+			length -= PesPayloadOffset(payload);
+			payload += PesPayloadOffset(payload);
 		}
 
-		// skip PES header, proceed with payload towards OMX
-		Length -= PesPayloadOffset(Data);
-		Data += PesPayloadOffset(Data);
+		if (m_tsVideoValid && Transferring())
+			AdjustLiveSpeed();
+	}
+
+	if (m_tsVideoValid && IsReversePlayback())
+	{
+		bool queued = QueueReverseVideo(payload, length, m_tsVideoPts);
+		if (queued)
+			m_tsVideoPts = OMX_INVALID_PTS;
+
+		Release(eVideoLock);
+		return queued ? Length : 0;
+	}
 
-		while (Length > 0)
+	// at fast speeds, the start of a frame is collected until its picture
+	// type is known, so dropped frames are never copied into OMX buffers
+	int head = 0;
+	if (m_tsVideoValid && m_tsVideoFrameStart && length > 0)
+	{
+		if (DropVideoFrames())
 		{
-			if (OMX_BUFFERHEADERTYPE *buf =	m_omx->GetVideoBuffer(
-					pts != OMX_INVALID_PTS ? m_videoPts : OMX_INVALID_PTS))
-			{
-				buf->nFilledLen = buf->nAllocLen < (unsigned)Length ?
-						buf->nAllocLen : Length;
+			head = min(length, TS_VIDEO_HEAD_SIZE - m_tsVideoHeadLength);
+			memcpy(m_tsVideoHead + m_tsVideoHeadLength, payload, head);
+			m_tsVideoHeadLength += head;
+
+			cVideoParser::ePictureType type = cVideoParser::GetPictureType(
+					m_videoCodec, m_tsVideoHead, m_tsVideoHeadLength);
 
-				memcpy(buf->pBuffer, Data, buf->nFilledLen);
-				Length -= buf->nFilledLen;
-				Data += buf->nFilledLen;
+			if (type == cVideoParser::eUnknown &&
+					m_tsVideoHeadLength < TS_VIDEO_HEAD_SIZE)
+			{
+				Release(eVideoLock);
+				return Length;
+			}
+			m_dropVideo = DropVideoFrame(type);
+		}
+		m_tsVideoFrameStart = false;
+	}
 
-				if (EndOfFrame && !Length)
-					buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+	// skip the rest of a frame whose beginning failed to be submitted
+	if (m_tsVideoBuffer && m_tsVideoBuffer->nAllocLen -
+			m_tsVideoBuffer->nFilledLen < (unsigned)length &&
+			!SubmitTsVideo(false))
+		m_tsVideoValid = false;
 
-				if (!m_omx->EmptyVideoBuffer(buf))
+	// skip data until decoder is set up and next PES packet starts, skip
+	// dropped frames completely
+	if (m_tsVideoValid && !m_dropVideo && length > 0)
+	{
+		if (!m_tsVideoBuffer)
+		{
+			m_tsVideoBuffer = m_omx->GetVideoBuffer(m_tsVideoPts);
+			if (!m_tsVideoBuffer)
+			{
+				// VDR will repeat this packet, so forget about its part of
+				// the collected frame start
+				if (head)
 				{
-					ret = 0;
-					ELOG("failed to pass buffer to video decoder!");
-					break;
+					m_tsVideoHeadLength -= head;
+					m_tsVideoFrameStart = true;
+					m_dropVideo = false;
 				}
+				Release(eVideoLock);
+				return 0;
 			}
-			else
-			{
-				ret = 0;
-				break;
-			}
-			pts = OMX_INVALID_PTS;
+			m_tsVideoPts = OMX_INVALID_PTS;
+		}
+
+		// collected start of the frame first, the buffer is still empty
+		if (m_tsVideoHeadLength)
+		{
+			memcpy(m_tsVideoBuffer->pBuffer, m_tsVideoHead,
+					m_tsVideoHeadLength);
+			m_tsVideoBuffer->nFilledLen = m_tsVideoHeadLength;
+			m_tsVideoHeadLength = 0;
+			payload += head;
+			length -= head;
 		}
+
+		memcpy(m_tsVideoBuffer->pBuffer + m_tsVideoBuffer->nFilledLen,
+				payload, length);
+		m_tsVideoBuffer->nFilledLen += length;
 	}
-	m_mutex->Unlock();
 
-	if (Transferring() && !ret)
-		DBG("failed to write %d bytes of video packet!", Length);
+	Release(eVideoLock);
+	return Length;
+}
 
-	if (ret && Transferring())
-		AdjustLiveSpeed();
+bool cOmxDevice::SubmitTsVideo(bool endOfFrame)
+{
+	if (m_tsVideoBuffer)
+	{
+		ParseVideoFormat(m_tsVideoBuffer->pBuffer, m_tsVideoBuffer->nFilledLen);
 
-	return ret;
+		if (endOfFrame)
+			m_tsVideoBuffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+
+		// cOmx takes back a buffer which failed to be emptied
+		OMX_BUFFERHEADERTYPE *buf = m_tsVideoBuffer;
+		m_tsVideoBuffer = 0;
+		if (!m_omx->EmptyVideoBuffer(buf))
+		{
+			ELOG("failed to pass buffer to video decoder!");
+			return false;
+		}
+	}
+	return true;
+}
+
+void cOmxDevice::ResetTsVideo(void)
+{
+	if (m_tsVideoBuffer)
+	{
+		m_omx->ReleaseVideoBuffer(m_tsVideoBuffer);
+		m_tsVideoBuffer = 0;
+	}
+	m_tsVideoPts = OMX_INVALID_PTS;
+	m_tsVideoValid = false;
+	m_tsVideoFrameStart = false;
+	m_tsVideoHeadLength = 0;
+	m_dropVideo = false;
+}
+
+bool cOmxDevice::DropVideoFrame(cVideoParser::ePictureType type)
+{
+	// only feed the decoder with what can be displayed at fast speeds: no
+	// non-reference pictures at the faster speed and only pictures decodable
+	// on their own at the fastest speed, where VDR sends I-frames only
+	bool drop = m_playbackSpeed == eFastest ?
+			type == cVideoParser::eReference ||
+			type == cVideoParser::eNonReference :
+			type == cVideoParser::eNonReference;
+
+	m_fastVideoFrames++;
+	if (drop)
+		m_droppedVideoFrames++;
+
+	return drop;
+}
+
+void cOmxDevice::LogDroppedVideoFrames(void)
+{
+	if (m_fastVideoFrames)
+		DLOG("dropped %d of %d video frames at fast forward",
+				m_droppedVideoFrames, m_fastVideoFrames);
+
+	m_droppedVideoFrames = 0;
+	m_fastVideoFrames = 0;
+}
+
+bool cOmxDevice::PollVideo(void)
+{
+	// complete frames waiting for reverse playback have to be passed to the
+	// decoder first, before new data can be accepted
+	ReleaseReverseVideo();
+	return !m_reverseCache->Full() && m_omx->PollVideo();
+}
+
+bool cOmxDevice::QueueReverseVideo(const uchar *data, int length, int64_t pts)
+{
+	// VDR delivers the independent frames backwards, they're cached until
+	// the following frame arrives and then get passed to the decoder with
+	// increasing time stamps, while the clock is running forward
+	if (pts != OMX_INVALID_PTS)
+		m_reverseCache->Add(pts);
+
+	// if the data can't be cached, let VDR repeat the packet
+	if (length > 0 && !m_reverseCache->Append(data, length))
+		return false;
+
+	ReleaseReverseVideo();
+	return true;
+}
+
+void cOmxDevice::ReleaseReverseVideo(void)
+{
+	int scale = s_playbackSpeeds[eForward][m_playbackSpeed];
+
+	while (const cRpiGopCache::AccessUnit *unit = m_reverseCache->Front())
+	{
+		if (!scale || !m_omx->PollVideo())
+			break;
+
+		if (m_reversePts == OMX_INVALID_PTS)
+			m_reversePts = unit->pts;
+
+		// each frame is shown for its distance to the following frame in
+		// the stream, stretched according to the requested speed
+		int64_t distance = unit->duration > REVERSE_MAX_PTS_DISTANCE ?
+				REVERSE_DEFAULT_PTS_DISTANCE : unit->duration;
+		int64_t duration =
+				distance * s_playbackSpeeds[eForward][eNormal] / scale;
+
+		// a frame spans several buffers, so if they run out, keep the
+		// remainder and continue with the next poll
+		int submitted = 0;
+		bool complete = SubmitVideo(unit->data + unit->submitted,
+				unit->length - unit->submitted,
+				unit->submitted ? OMX_INVALID_PTS : m_reversePts, true,
+				&submitted);
+
+		m_reverseCache->Submitted(submitted);
+		if (!complete)
+			break;
+
+		m_reverseCache->Pop(m_reversePts, duration);
+		m_reversePts += duration;
+	}
+}
+
+void cOmxDevice::ResetReverseVideo(void)
+{
+	m_reverseCache->Clear();
+	m_reversePts = OMX_INVALID_PTS;
 }
 
 bool cOmxDevice::SubmitEOS(void)
@@ -474,6 +929,15 @@ bool cOmxDevice::SubmitEOS(void)
 int64_t cOmxDevice::GetSTC(void)
 {
 	int64_t stc = m_omx->GetSTC();
+
+	// map the presentation time back to the stream during reverse playback
+	if (stc != OMX_INVALID_PTS && IsReversePlayback())
+	{
+		Acquire(eVideoLock);
+		stc = m_reverseCache->Translate(stc);
+		Release(eVideoLock);
+	}
+
 	if (stc != OMX_INVALID_PTS)
 		m_lastStc = stc;
 	return m_lastStc & MAX33BIT;
@@ -492,19 +956,30 @@ uchar *cOmxDevice::GrabImage(int &Size, bool Jpeg, int Quality,
 	SizeY = (SizeY > 0) ? SizeY : height;
 	Quality = (Quality >= 0) ? Quality : 100;
 
-	// bigger than needed, but uint32_t ensures proper alignment
-	uint8_t* frame = (uint8_t*)(MALLOC(uint32_t, SizeX * SizeY));
+	m_grabMutex->Lock();
+
+	// keep the image buffer for subsequent grabs, bigger than needed, but
+	// uint32_t ensures proper alignment
+	if (m_grabBufferSize < SizeX * SizeY)
+	{
+		free(m_grabBuffer);
+		m_grabBuffer = (uint8_t*)(MALLOC(uint32_t, SizeX * SizeY));
+		m_grabBufferSize = m_grabBuffer ? SizeX * SizeY : 0;
+	}
+	uint8_t* frame = m_grabBuffer;
+	m_grabLastUse = cTimeMs::Now();
 
 	if (!frame)
 	{
 		ELOG("failed to allocate image buffer!");
+		m_grabMutex->Unlock();
 		return ret;
 	}
 
 	if (cRpiDisplay::Snapshot(frame, SizeX, SizeY))
 	{
 		ELOG("failed to grab image!");
-		free(frame);
+		m_grabMutex->Unlock();
 		return ret;
 	}
 
@@ -523,58 +998,79 @@ uchar *cOmxDevice::GrabImage(int &Size, bool Jpeg, int Quality,
 			memcpy(ret + l, frame, SizeX * SizeY * 3);
 		}
 	}
-	free(frame);
+	m_grabMutex->Unlock();
 	return ret;
 }
 
+void cOmxDevice::CheckGrabTimeout(void)
+{
+	m_grabMutex->Lock();
+	if (m_grabBuffer && cTimeMs::Now() - m_grabLastUse > SNAPSHOT_IDLE_TIMEOUT)
+	{
+		DBG("releasing idle grab buffer");
+		free(m_grabBuffer);
+		m_grabBuffer = 0;
+		m_grabBufferSize = 0;
+	}
+	m_grabMutex->Unlock();
+}
+
 void cOmxDevice::Clear(void)
 {
 	DBG("Clear()");
-	m_mutex->Lock();
+	AcquireAll();
 
+	ResetTsVideo();
+	ResetReverseVideo();
 	FlushStreams();
 	m_hasAudio = false;
 	m_hasVideo = false;
+	m_parseVideoFormat = false;
+	cRpiZapStat::Start();
+	m_preRoll->Start(0);
+	m_preRollPending = Transferring();
 
-	m_mutex->Unlock();
+	ReleaseAll();
 	cDevice::Clear();
 }
 
 void cOmxDevice::Play(void)
 {
 	DBG("Play()");
-	m_mutex->Lock();
+	AcquireAll();
 
 	m_playbackSpeed = eNormal;
 	m_direction = eForward;
-	m_omx->SetClockScale(s_playbackSpeeds[m_direction][m_playbackSpeed]);
+	m_omx->SetClockScale(ClockScale());
+
+	LogDroppedVideoFrames();
 
-	m_mutex->Unlock();
+	ReleaseAll();
 	cDevice::Play();
 }
 
 void cOmxDevice::Freeze(void)
 {
 	DBG("Freeze()");
-	m_mutex->Lock();
+	Acquire(eStateLock);
 
 	m_omx->SetClockScale(s_playbackSpeeds[eForward][ePause]);
 
-	m_mutex->Unlock();
+	Release(eStateLock);
 	cDevice::Freeze();
 }
 
 #if APIVERSNUM >= 20103
 void cOmxDevice::TrickSpeed(int Speed, bool Forward)
 {
-	m_mutex->Lock();
+	AcquireAll();
 	ApplyTrickSpeed(Speed, Forward);
-	m_mutex->Unlock();
+	ReleaseAll();
 }
 #else
 void cOmxDevice::TrickSpeed(int Speed)
 {
-	m_mutex->Lock();
+	AcquireAll();
 	m_audioPts = 0;
 	m_videoPts = 0;
 	m_playDirection = 0;
@@ -585,7 +1081,7 @@ void cOmxDevice::TrickSpeed(int Speed)
 	else
 		ApplyTrickSpeed(Speed, (Speed == 8 || Speed == 4 || Speed == 2));
 
-	m_mutex->Unlock();
+	ReleaseAll();
 }
 #endif
 
@@ -609,14 +1105,27 @@ void cOmxDevice::ApplyTrickSpeed(int trickSpeed, bool forward)
 		trickSpeed == 48 ? eSlower  :
 		trickSpeed == 24 ? eSlow    : eNormal;
 
-	m_omx->SetClockScale(s_playbackSpeeds[m_direction][m_playbackSpeed]);
+	m_omx->SetClockScale(ClockScale());
+
+	LogDroppedVideoFrames();
 
 	DBG("ApplyTrickSpeed(%s, %s)",
 			PlaybackSpeedStr(m_playbackSpeed), DirectionStr(m_direction));
 	return;
 }
 
-void cOmxDevice::PtsTracker(int64_t ptsDiff)
+void cOmxDevice::StartPreRoll(void)
+{
+	// VDR attaches the transfer player before it updates the current channel,
+	// so the channel is only taken once the first packet arrives
+	if (m_preRollPending)
+	{
+		m_preRollPending = false;
+		m_preRoll->Start(CurrentChannel());
+	}
+}
+
+void cOmxDevice::PtsTracker(int64_t ptsDiff, bool videoPath)
 {
 	DBG("PtsTracker(%lld)", ptsDiff);
 
@@ -625,7 +1134,12 @@ void cOmxDevice::PtsTracker(int64_t ptsDiff)
 	else if (ptsDiff > 0)
 		m_playDirection += 2;
 
-	if (m_playDirection < -2 || m_playDirection > 3)
+	// speed and direction decide how the video path handles its frames and
+	// ApplyTrickSpeed() resets its counters, so unless there's no video, the
+	// new speed is applied by the video path at the start of a frame, where
+	// it's called with the video lock held in addition to the state lock
+	if ((m_playDirection < -2 || m_playDirection > 3) &&
+			(videoPath || !m_hasVideo))
 	{
 		ApplyTrickSpeed(m_trickRequest, m_playDirection > 0);
 		m_trickRequest = 0;
@@ -634,68 +1148,142 @@ void cOmxDevice::PtsTracker(int64_t ptsDiff)
 
 bool cOmxDevice::HasIBPTrickSpeed(void)
 {
-	return !m_hasVideo;
+	// VDR sends the full stream forward up to the faster speed, where frames
+	// are dropped by the device, see DropVideoFrame(). At the fastest speed
+	// and backwards, it only sends I-frames.
+	Acquire(eStateLock);
+	bool ret = !m_hasVideo || m_playbackSpeed != eFastest;
+	Release(eStateLock);
+	return ret;
+}
+
+void cOmxDevice::StartClock(void)
+{
+	int preRoll = Transferring() ? m_preRoll->Get() : PRE_ROLL_PLAYBACK;
+	DBG("start clock with %dms pre-roll", preRoll);
+
+	m_omx->SetClockScale(ClockScale());
+	m_omx->StartClock(m_hasVideo, m_hasAudio, preRoll);
+
+	ResetLiveSpeed();
 }
 
 void cOmxDevice::AdjustLiveSpeed(void)
 {
-	if (m_timer->TimedOut())
+	Acquire(eStateLock);
+	if (!m_timer->TimedOut())
+	{
+		Release(eStateLock);
+		return;
+	}
+
+	m_timer->Set(LIVE_SPEED_INTERVAL);
+
+	// the latency is given by the time stamp of the latest packet written
+	// and the current media time, take audio if present as it's written in
+	// smaller chunks
+	int64_t stc = m_omx->GetSTC();
+	int64_t pts = m_hasAudio ? m_audioPts : m_videoPts;
+	if (stc == OMX_INVALID_PTS || !pts)
+	{
+		Release(eStateLock);
+		return;
+	}
+
+	// a cached STC of a clock which hasn't been seen running yet is only
+	// accurate to its age, skip it rather than feeding a wrong latency
+	if (m_omx->GetSTCAccuracy() > LIVE_SPEED_STC_ERR * 90)
 	{
-		int usedBuffers, usedAudioBuffers, usedVideoBuffers;
-		m_omx->GetBufferUsage(usedAudioBuffers, usedVideoBuffers);
-		usedBuffers = m_hasAudio ? usedAudioBuffers : usedVideoBuffers;
+		Release(eStateLock);
+		return;
+	}
+
+	// filter out packet granularity and transmission jitter
+	int latency = (pts - stc) / 90;
+	m_liveLatency = m_liveLatency < 0 ? latency :
+			0.75 * m_liveLatency + 0.25 * latency;
+
+	// PI controller: speed up if more than the target latency is buffered
+	// without configured latency, target the current pre-roll
+	int target = cRpiSetup::LiveLatency() ?
+			cRpiSetup::LiveLatency() : m_preRoll->Get();
+
+	double error = m_liveLatency - target;
+	double integral = m_liveIntegral + LIVE_SPEED_KP * error *
+			LIVE_SPEED_INTERVAL / (LIVE_SPEED_TI * 1000.0);
 
-		if (usedBuffers < 5)
-			m_liveSpeed = eNegCorrection;
+	double ppm = LIVE_SPEED_KP * error + integral;
 
-		else if (usedBuffers > 15)
-			m_liveSpeed = ePosCorrection;
+	// anti wind-up: stop integrating while the output is saturated
+	if (ppm > LIVE_SPEED_MAX_PPM)
+		ppm = LIVE_SPEED_MAX_PPM;
+	else if (ppm < -LIVE_SPEED_MAX_PPM)
+		ppm = -LIVE_SPEED_MAX_PPM;
+	else
+		m_liveIntegral = integral;
 
-		else if ((usedBuffers > 10 && m_liveSpeed == eNegCorrection) ||
-				(usedBuffers < 10 && m_liveSpeed == ePosCorrection))
-			m_liveSpeed = eNoCorrection;
+	int scale = S(1.0f) + (int)round(ppm * S(1.0f) / 1000000);
 
 #ifdef DEBUG_BUFFERSTAT
-		DLOG("buffer usage: A=%3d%%, V=%3d%%, Corr=%d",
-				usedAudioBuffers, usedVideoBuffers,
-				m_liveSpeed == eNegMaxCorrection ? -2 :
-				m_liveSpeed == eNegCorrection    ? -1 :
-				m_liveSpeed == eNoCorrection     ?  0 :
-				m_liveSpeed == ePosCorrection    ?  1 :
-				m_liveSpeed == ePosMaxCorrection ?  2 : 0);
+	int usedAudioBuffers, usedVideoBuffers;
+	m_omx->GetBufferUsage(usedAudioBuffers, usedVideoBuffers);
+	DLOG("live speed: latency=%dms (%dms), target=%dms, P=%+.1fppm, "
+			"I=%+.1fppm, corr=%+.0fppm, A=%3d%%, V=%3d%%",
+			latency, (int)m_liveLatency, target,
+			LIVE_SPEED_KP * error, m_liveIntegral,
+			(scale - S(1.0f)) * 1000000.0 / S(1.0f),
+			usedAudioBuffers, usedVideoBuffers);
 #endif
-		m_omx->SetClockScale(s_liveSpeeds[m_liveSpeed]);
-		m_timer->Set(1000);
+
+	// clock scale resolution is about 15ppm
+	if (scale != m_liveScale)
+	{
+		m_omx->SetClockScale(scale);
+		m_liveScale = scale;
 	}
+	Release(eStateLock);
+}
+
+void cOmxDevice::ResetLiveSpeed(void)
+{
+	// keep the integral part, as it reflects the clock deviation to the
+	// broadcaster, which usually doesn't change much between channels
+	m_liveScale = ClockScale();
+	m_liveLatency = -1;
+	m_timer->Set(LIVE_SPEED_INTERVAL);
 }
 
 void cOmxDevice::HandleBufferStall()
 {
 	ELOG("buffer stall!");
-	m_mutex->Lock();
+	AcquireAll();
 
+	if (Transferring())
+		m_preRoll->Stall();
+
+	ResetTsVideo();
+	ResetReverseVideo();
 	FlushStreams(true);
 	m_omx->StopVideo();
 
 	m_hasAudio = false;
 	m_hasVideo = false;
+	m_parseVideoFormat = false;
 	m_videoCodec = cVideoCodec::eInvalid;
 
-	m_mutex->Unlock();
+	ReleaseAll();
 }
 
 void cOmxDevice::HandleEndOfStream()
 {
 	DBG("HandleEndOfStream()");
-	m_mutex->Lock();
+	AcquireAll();
 
 	// flush pipes and restart clock after still image
 	FlushStreams();
-	m_omx->SetClockScale(s_playbackSpeeds[m_direction][m_playbackSpeed]);
-	m_omx->StartClock(m_hasVideo, m_hasAudio,
-			Transferring() ? PRE_ROLL_LIVE : PRE_ROLL_PLAYBACK);
+	StartClock();
 
-	m_mutex->Unlock();
+	ReleaseAll();
 }
 
 void cOmxDevice::HandleStreamStart()
@@ -709,6 +1297,7 @@ void cOmxDevice::HandleStreamStart()
 			format->pixelWidth, format->pixelHeight);
 
 	HandleVideoSetupChanged();
+	cRpiZapStat::Mark(cRpiZapStat::eDisplayMode);
 }
 
 void cOmxDevice::HandleVideoSetupChanged()
@@ -778,16 +1367,129 @@ void cOmxDevice::SetVolumeDevice(int Volume)
 
 bool cOmxDevice::Poll(cPoller &Poller, int TimeoutMs)
 {
-	cTimeMs timer(TimeoutMs);
-	while (!m_omx->PollVideo() || !m_audio->Poll())
+	uint64_t timeout = cTimeMs::Now() + TimeoutMs;
+	bool ret = false;
+	while (true)
 	{
-		if (timer.TimedOut())
-			return false;
-		cCondWait::SleepMs(5);
+		Acquire(eVideoLock);
+		bool video = PollVideo();
+
+		// a full reverse cache can't be drained while paused, although the
+		// decoder may have free buffers, so don't wait for them then
+		bool videoBuffers = video || m_omx->PollVideo();
+		Release(eVideoLock);
+
+		bool audio = m_audio->Poll();
+		if (video && audio)
+		{
+			ret = true;
+			break;
+		}
+
+		int64_t remaining = timeout - cTimeMs::Now();
+		if (remaining <= 0)
+			break;
+
+		// video buffers get signaled by OMX once they're drained below the
+		// low water mark, free audio space by the audio decoder thread. A
+		// full reverse cache only drains after resuming, so just check again
+		// later then.
+		if (!videoBuffers)
+			m_omx->WaitForVideoBuffers((int)remaining);
+		else if (!audio)
+			m_audio->WaitForSpace((int)remaining);
+		else
+			cCondWait::SleepMs(remaining < 20 ? (int)remaining : 20);
+
+#ifdef DEBUG_BUFFERSTAT
+		m_pollWakeups++;
+#endif
 	}
-	return true;
+
+#ifdef DEBUG_BUFFERSTAT
+	if (cTimeMs::Now() - m_pollStatTime > 10000)
+	{
+		DLOG("poll wake-ups: %d, rejected video packets: %d (last %ds)",
+				m_pollWakeups, m_rejectedVideoPackets,
+				(int)((cTimeMs::Now() - m_pollStatTime) / 1000));
+		m_pollWakeups = 0;
+		m_rejectedVideoPackets = 0;
+		m_pollStatTime = cTimeMs::Now();
+		LogLockStat();
+	}
+#endif
+	return ret;
+}
+
+#ifdef DEBUG_BUFFERSTAT
+void cOmxDevice::Acquire(eLock lock)
+{
+	uint64_t start = cTimeUs::Now();
+	m_mutex[lock]->Lock();
+
+	// only the outermost lock of a recursive locking is accounted
+	LockStat *stat = &m_lockStat[lock];
+	if (!stat->depth++)
+	{
+		uint64_t now = cTimeUs::Now();
+		uint64_t wait = now - start;
+		stat->lockTime = now;
+		stat->acquired++;
+		stat->waitTotal += wait;
+		if (wait > stat->waitMax)
+			stat->waitMax = wait;
+		if (wait > LOCKSTAT_CONTENDED)
+			stat->contended++;
+	}
+}
+
+void cOmxDevice::Release(eLock lock)
+{
+	LockStat *stat = &m_lockStat[lock];
+	if (!--stat->depth)
+	{
+		uint64_t hold = cTimeUs::Now() - stat->lockTime;
+		stat->holdTotal += hold;
+		if (hold > stat->holdMax)
+			stat->holdMax = hold;
+	}
+	m_mutex[lock]->Unlock();
+}
+
+void cOmxDevice::LogLockStat(void)
+{
+	for (int i = 0; i < eNumLocks; i++)
+	{
+		eLock lock = static_cast<eLock>(i);
+
+		// take the lock directly to not count the statistics itself
+		m_mutex[lock]->Lock();
+		LockStat stat = m_lockStat[lock];
+		memset(&m_lockStat[lock], 0, sizeof(LockStat));
+		m_lockStat[lock].depth = stat.depth;
+		m_lockStat[lock].lockTime = stat.lockTime;
+		m_mutex[lock]->Unlock();
+
+		if (stat.acquired)
+			DLOG("%s lock: %d acquired, %d contended, wait avg=%dus "
+					"max=%dus, hold avg=%dus max=%dus", LockStr(lock),
+					stat.acquired, stat.contended,
+					(int)(stat.waitTotal / stat.acquired), (int)stat.waitMax,
+					(int)(stat.holdTotal / stat.acquired), (int)stat.holdMax);
+	}
+}
+#else
+void cOmxDevice::Acquire(eLock lock)
+{
+	m_mutex[lock]->Lock();
 }
 
+void cOmxDevice::Release(eLock lock)
+{
+	m_mutex[lock]->Unlock();
+}
+#endif
+
 void cOmxDevice::MakePrimaryDevice(bool On)
 {
 	if (On && m_onPrimaryDevice)
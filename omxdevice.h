@@ -23,10 +23,18 @@
 #include <vdr/device.h>
 
 #include "tools.h"
+#include "videoparser.h"
+
+// start of a TS video frame collected to get its picture type at fast speeds
+#define TS_VIDEO_HEAD_SIZE 2048 // bytes
 
 class cOmx;
 class cRpiAudioDecoder;
 class cMutex;
+class cRpiGopCache;
+class cRpiPreRoll;
+
+struct OMX_BUFFERHEADERTYPE;
 
 class cOmxDevice : cDevice
 {
@@ -64,11 +72,16 @@ public:
 
 	virtual int PlayVideo(const uchar *Data, int Length, bool EndOfFrame);
 
+	virtual int PlayTs(const uchar *Data, int Length, bool VideoOnly = false);
+
 	virtual int64_t GetSTC(void);
 
 	virtual uchar *GrabImage(int &Size, bool Jpeg = true, int Quality = -1,
 			int SizeX = -1, int SizeY = -1);
 
+	// release the grab buffer if unused for SNAPSHOT_IDLE_TIMEOUT
+	void CheckGrabTimeout(void);
+
 #if APIVERSNUM >= 20103
 	virtual void TrickSpeed(int Speed, bool Forward);
 #else
@@ -87,6 +100,8 @@ protected:
 
 	virtual void MakePrimaryDevice(bool On);
 
+	virtual int PlayTsVideo(const uchar *Data, int Length);
+
 	enum eDirection {
 		eForward,
 		eBackward,
@@ -121,25 +136,7 @@ protected:
 				speed == eFastest ? "fastest" : "unknown";
 	}
 
-	enum eLiveSpeed {
-		eNegMaxCorrection,
-		eNegCorrection,
-		eNoCorrection,
-		ePosCorrection,
-		ePosMaxCorrection,
-		eNumLiveSpeeds
-	};
-
-	static const char* LiveSpeedStr(eLiveSpeed corr) {
-		return	corr == eNegMaxCorrection ? "max negative" :
-				corr == eNegCorrection    ? "negative"     :
-				corr == eNoCorrection     ? "no"           :
-				corr == ePosCorrection    ? "positive"     :
-				corr == ePosMaxCorrection ? "max positive" : "unknown";
-	}
-
 	static const int s_playbackSpeeds[eNumDirections][eNumPlaybackSpeeds];
-	static const int s_liveSpeeds[eNumLiveSpeeds];
 
 	static const uchar s_pesVideoHeader[14];
 	static const uchar s_mpeg2EndOfSequence[4];
@@ -170,20 +167,87 @@ private:
 	void FlushStreams(bool flushVideoRender = false);
 	bool SubmitEOS(void);
 
+	int64_t ProcessVideoPesHeader(const uchar *Data, int Length);
+	void ParseVideoFormat(const uchar *data, int length);
+	bool SubmitVideo(const uchar *data, int length, int64_t pts,
+			bool endOfFrame, int *submitted = 0);
+
+	bool SubmitTsVideo(bool endOfFrame);
+	void ResetTsVideo(void);
+
+	bool DropVideoFrames(void) {
+		return m_direction == eForward && m_playbackSpeed >= eFaster;
+	}
+
+	bool DropVideoFrame(cVideoParser::ePictureType type);
+	void LogDroppedVideoFrames(void);
+
+	bool IsReversePlayback(void) {
+		return m_direction == eBackward && m_playbackSpeed != ePause;
+	}
+
+	int ClockScale(void) {
+		return IsReversePlayback() ? s_playbackSpeeds[eForward][eNormal] :
+				s_playbackSpeeds[m_direction][m_playbackSpeed];
+	}
+
+	bool PollVideo(void);
+	bool QueueReverseVideo(const uchar *data, int length, int64_t pts);
+	void ReleaseReverseVideo(void);
+	void ResetReverseVideo(void);
+
 	void ApplyTrickSpeed(int trickSpeed, bool forward);
-	void PtsTracker(int64_t ptsDiff);
+	void StartPreRoll(void);
+	void PtsTracker(int64_t ptsDiff, bool videoPath);
+
+	void StartClock(void);
 
 	void AdjustLiveSpeed(void);
+	void ResetLiveSpeed(void);
+
+	/*
+	 * Audio and video are fed independently, each path holds its own lock
+	 * while parsing and copying data. The state lock is only held briefly
+	 * for what both paths share: which streams have started, the unwrapped
+	 * PTS of both streams, the clock start and the live speed control.
+	 * The first stream with a valid PTS starts the clock, the second one
+	 * derives its PTS offset from the first one's PTS, both under the state
+	 * lock. Control operations (play mode, trick speed, clear, callbacks)
+	 * take all locks, so a path sees a consistent state while holding its
+	 * own lock. Locks are always taken in the order of eLock.
+	 */
+	enum eLock {
+		eVideoLock,
+		eAudioLock,
+		eStateLock,
+		eNumLocks
+	};
+
+	static const char* LockStr(eLock lock) {
+		return 	lock == eVideoLock ? "video" :
+				lock == eAudioLock ? "audio" :
+				lock == eStateLock ? "state" : "unknown";
+	}
+
+	void Acquire(eLock lock);
+	void Release(eLock lock);
+
+	void AcquireAll(void) {
+		Acquire(eVideoLock); Acquire(eAudioLock); Acquire(eStateLock);
+	}
+
+	void ReleaseAll(void) {
+		Release(eStateLock); Release(eAudioLock); Release(eVideoLock);
+	}
 
 	cOmx			 *m_omx;
 	cRpiAudioDecoder *m_audio;
-	cMutex			 *m_mutex;
+	cMutex			 *m_mutex[eNumLocks];
 	cTimeMs 		 *m_timer;
 
 	cVideoCodec::eCodec	m_videoCodec;
 
 	ePlayMode           m_playMode;
-	eLiveSpeed          m_liveSpeed;
 	ePlaybackSpeed      m_playbackSpeed;
 	eDirection          m_direction;
 
@@ -199,8 +263,58 @@ private:
 
 	int64_t	m_lastStc;
 
+	int		m_liveScale;
+	double	m_liveLatency;
+	double	m_liveIntegral;
+
+	struct OMX_BUFFERHEADERTYPE *m_tsVideoBuffer;
+	int64_t	m_tsVideoPts;
+	bool	m_tsVideoValid;
+	bool	m_tsVideoFrameStart;
+	uchar	m_tsVideoHead[TS_VIDEO_HEAD_SIZE];
+	int		m_tsVideoHeadLength;
+
+	bool	m_dropVideo;
+	int		m_droppedVideoFrames;
+	int		m_fastVideoFrames;
+
+	bool	m_parseVideoFormat;
+
+	cRpiGopCache *m_reverseCache;
+	int64_t	m_reversePts;
+
+	cRpiPreRoll *m_preRoll;
+	bool         m_preRollPending;
+
+	cMutex  *m_grabMutex;
+	uint8_t *m_grabBuffer;
+	int      m_grabBufferSize;
+	uint64_t m_grabLastUse;
+
 	int m_display;
 	int m_layer;
+
+#ifdef DEBUG_BUFFERSTAT
+	int      m_pollWakeups;
+	int      m_rejectedVideoPackets;
+	uint64_t m_pollStatTime;
+
+	void LogLockStat(void);
+
+	struct LockStat
+	{
+		int      depth;      // recursion depth of current owner
+		uint64_t lockTime;   // us, when current owner got the lock
+		int      acquired;
+		int      contended;  // waited for more than LOCKSTAT_CONTENDED us
+		uint64_t waitTotal;
+		uint64_t waitMax;
+		uint64_t holdTotal;
+		uint64_t holdMax;
+	};
+
+	LockStat m_lockStat[eNumLocks];
+#endif
 };
 
 #endif
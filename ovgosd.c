@@ -18,7 +18,8 @@
  */
 
 #include <vector>
-#include <queue>
+#include <list>
+#include <map>
 #include <algorithm>
 
 #include <ft2build.h>
@@ -37,81 +38,378 @@
 
 /* ------------------------------------------------------------------------- */
 
-// glyphs containing kerning cache, based on VDR's implementation
+// glyph metrics, based on VDR's implementation
 
-class cOvgGlyph : public cListObject
+class cOvgGlyph
 {
 public:
 
-	cOvgGlyph(uint charCode, VGfloat advanceX, VGfloat advanceY) :
-		m_charCode(charCode), m_advanceX(advanceX), m_advanceY(advanceY) { }
+	cOvgGlyph(uint charCode, uint index, VGfloat advanceX, VGfloat advanceY) :
+		m_charCode(charCode), m_index(index),
+		m_advanceX(advanceX), m_advanceY(advanceY) { }
 
 	virtual ~cOvgGlyph() { }
 
 	uint    CharCode(void) { return m_charCode; }
+	uint    Index(void)    { return m_index;    }
 	VGfloat AdvanceX(void) { return m_advanceX; }
 	VGfloat AdvanceY(void) { return m_advanceY; }
 
-	bool GetKerningCache(uint prevSym, VGfloat &kerning)
+private:
+
+	uint m_charCode;
+	uint m_index; // FreeType glyph index
+
+	VGfloat m_advanceX;
+	VGfloat m_advanceY;
+};
+
+/* ------------------------------------------------------------------------- */
+
+// glyph lookup table, owning all glyphs of a font: characters of the basic
+// multilingual plane are directly indexed by a two-level table with pages of
+// 256 characters allocated on demand, all others are kept in a hash table
+
+#define GLYPH_PAGE_BITS  8
+#define GLYPH_PAGE_SIZE  (1 << GLYPH_PAGE_BITS)
+#define GLYPH_PAGES      (0x10000 >> GLYPH_PAGE_BITS)
+#define GLYPH_HASH_SIZE  64 // initial size, power of two
+
+class cOvgGlyphTable
+{
+public:
+
+	cOvgGlyphTable() :
+		m_hash(0),
+		m_hashSize(0),
+		m_hashCount(0)
 	{
-		for (int i = m_kerningCache.Size(); --i > 0; )
-			if (m_kerningCache[i].m_prevSym == prevSym)
+		memset(m_pages, 0, sizeof(m_pages));
+	}
+
+	~cOvgGlyphTable()
+	{
+		for (int i = 0; i < GLYPH_PAGES; i++)
+			if (m_pages[i])
 			{
-				kerning = m_kerningCache[i].m_kerning;
+				for (int j = 0; j < GLYPH_PAGE_SIZE; j++)
+					delete m_pages[i][j];
+				delete[] m_pages[i];
+			}
+
+		for (int i = 0; i < m_hashSize; i++)
+			delete m_hash[i];
+		delete[] m_hash;
+	}
+
+	cOvgGlyph* Get(uint charCode) const
+	{
+		if (charCode < 0x10000)
+		{
+			cOvgGlyph **page = m_pages[charCode >> GLYPH_PAGE_BITS];
+			return page ? page[charCode & (GLYPH_PAGE_SIZE - 1)] : 0;
+		}
+		if (!m_hashCount)
+			return 0;
+
+		for (int i = Hash(charCode); m_hash[i]; i = (i + 1) & (m_hashSize - 1))
+			if (m_hash[i]->CharCode() == charCode)
+				return m_hash[i];
+
+		return 0;
+	}
+
+	// takes ownership of glyph, which must not be in table yet
+	void Add(cOvgGlyph *glyph)
+	{
+		uint charCode = glyph->CharCode();
+		if (charCode < 0x10000)
+		{
+			cOvgGlyph **&page = m_pages[charCode >> GLYPH_PAGE_BITS];
+			if (!page)
+			{
+				page = new cOvgGlyph*[GLYPH_PAGE_SIZE];
+				memset(page, 0, GLYPH_PAGE_SIZE * sizeof(cOvgGlyph*));
+			}
+			page[charCode & (GLYPH_PAGE_SIZE - 1)] = glyph;
+			return;
+		}
+
+		// keep load factor below 50%, so probe sequences stay short
+		if (2 * (m_hashCount + 1) > m_hashSize)
+			Rehash(m_hashSize ? 2 * m_hashSize : GLYPH_HASH_SIZE);
+
+		Insert(glyph);
+		m_hashCount++;
+	}
+
+private:
+
+	int Hash(uint charCode) const
+	{
+		// Fibonacci hashing, spreads consecutive code points
+		return (charCode * 2654435769u) >> 16 & (m_hashSize - 1);
+	}
+
+	void Insert(cOvgGlyph *glyph)
+	{
+		int i = Hash(glyph->CharCode());
+		while (m_hash[i])
+			i = (i + 1) & (m_hashSize - 1);
+		m_hash[i] = glyph;
+	}
+
+	void Rehash(int size)
+	{
+		cOvgGlyph **old = m_hash;
+		int oldSize = m_hashSize;
+
+		m_hash = new cOvgGlyph*[size];
+		memset(m_hash, 0, size * sizeof(cOvgGlyph*));
+		m_hashSize = size;
+
+		for (int i = 0; i < oldSize; i++)
+			if (old[i])
+				Insert(old[i]);
+
+		delete[] old;
+	}
+
+	cOvgGlyph **m_pages[GLYPH_PAGES];
+
+	cOvgGlyph **m_hash;
+	int m_hashSize;
+	int m_hashCount;
+
+	cOvgGlyphTable(const cOvgGlyphTable&);
+	cOvgGlyphTable& operator= (const cOvgGlyphTable&);
+};
+
+/* ------------------------------------------------------------------------- */
+
+#define CHAR_HEIGHT (1 << 14)
+
+#define OVG_MAX_FONTS      64
+#define OVG_FONT_HASH_SIZE 128 // power of two, > OVG_MAX_FONTS
+
+class cOvgString;
+class cOvgStringCache;
+
+// kerning of character pairs: pairs of printable ASCII and Latin-1 characters
+// are held in a dense table, where the row of a left character is filled when
+// it's used first, all other pairs are cached in a hash table once they've
+// been used
+
+#define KERNING_DENSE_CHARS (95 + 96) // 0x20..0x7e and 0xa0..0xff
+#define KERNING_HASH_SIZE   256       // initial size, power of two
+
+class cOvgKerningTable
+{
+public:
+
+	cOvgKerningTable() :
+		m_face(0),
+		m_index(0),
+		m_hash(0),
+		m_hashSize(0),
+		m_hashCount(0)
+	{
+		for (int i = 0; i < KERNING_DENSE_CHARS; i++)
+			m_dense[i] = 0;
+	}
+
+	~cOvgKerningTable()
+	{
+		for (int i = 0; i < KERNING_DENSE_CHARS; i++)
+			delete[] m_dense[i];
+
+		delete[] m_index;
+		delete[] m_hash;
+	}
+
+	// index within dense table, -1 if not covered
+	static int DenseIndex(uint charCode)
+	{
+		return charCode >= 0x20 && charCode <= 0x7e ? charCode - 0x20 :
+			charCode >= 0xa0 && charCode <= 0xff ? charCode - 0xa0 + 95 : -1;
+	}
+
+	// to be called for fonts with kerning information only
+	void Init(FT_Face face)
+	{
+		m_face = face;
+	}
+
+	bool Get(uint prevSym, uint sym, VGfloat &kerning)
+	{
+		int prev = DenseIndex(prevSym), cur = DenseIndex(sym);
+		if (m_face && prev >= 0 && cur >= 0)
+		{
+			if (!m_dense[prev])
+				FillRow(prev);
+
+			kerning = m_dense[prev][cur];
+			return true;
+		}
+		if (!m_hashCount)
+			return false;
+
+		for (int i = Hash(prevSym, sym); m_hash[i].sym;
+				i = (i + 1) & (m_hashSize - 1))
+			if (m_hash[i].sym == sym && m_hash[i].prevSym == prevSym)
+			{
+				kerning = m_hash[i].kerning;
 				return true;
 			}
 
 		return false;
 	}
 
-	void SetKerningCache(uint prevSym, VGfloat kerning)
+	void Set(uint prevSym, uint sym, VGfloat kerning)
 	{
-		m_kerningCache.Append(tKerning(prevSym, kerning));
+		// keep load factor below 50%, so probe sequences stay short
+		if (2 * (m_hashCount + 1) > m_hashSize)
+			Rehash(m_hashSize ? 2 * m_hashSize : KERNING_HASH_SIZE);
+
+		Insert(prevSym, sym, kerning);
+		m_hashCount++;
 	}
 
 private:
 
-	struct tKerning
+	struct tPair
 	{
-	public:
+		uint prevSym;
+		uint sym;     // 0 if entry is unused
+		VGfloat kerning;
+	};
 
-		tKerning(uint prevSym, VGfloat kerning = 0.0f)
+	void FillRow(int prev)
+	{
+		if (!m_index)
 		{
-			m_prevSym = prevSym;
-			m_kerning = kerning;
+			m_index = new FT_UInt[KERNING_DENSE_CHARS];
+			for (uint ch = 0x20; ch <= 0xff; ch++)
+				if (DenseIndex(ch) >= 0)
+					m_index[DenseIndex(ch)] = FT_Get_Char_Index(m_face, ch);
 		}
 
-		uint m_prevSym;
-		VGfloat m_kerning;
-	};
+		m_dense[prev] = new VGfloat[KERNING_DENSE_CHARS];
+		for (int cur = 0; cur < KERNING_DENSE_CHARS; cur++)
+		{
+			FT_Vector delta;
+			delta.x = 0;
+			if (m_index[prev] && m_index[cur])
+				FT_Get_Kerning(m_face, m_index[prev], m_index[cur],
+						FT_KERNING_DEFAULT, &delta);
 
-	uint m_charCode;
+			m_dense[prev][cur] = (VGfloat)delta.x / CHAR_HEIGHT;
+		}
+	}
 
-	VGfloat m_advanceX;
-	VGfloat m_advanceY;
+	int Hash(uint prevSym, uint sym) const
+	{
+		return ((prevSym * 31 + sym) * 2654435769u) >> 16 & (m_hashSize - 1);
+	}
+
+	void Insert(uint prevSym, uint sym, VGfloat kerning)
+	{
+		int i = Hash(prevSym, sym);
+		while (m_hash[i].sym)
+			i = (i + 1) & (m_hashSize - 1);
+
+		m_hash[i].prevSym = prevSym;
+		m_hash[i].sym = sym;
+		m_hash[i].kerning = kerning;
+	}
+
+	void Rehash(int size)
+	{
+		tPair *old = m_hash;
+		int oldSize = m_hashSize;
+
+		m_hash = new tPair[size];
+		memset(m_hash, 0, size * sizeof(tPair));
+		m_hashSize = size;
+
+		for (int i = 0; i < oldSize; i++)
+			if (old[i].sym)
+				Insert(old[i].prevSym, old[i].sym, old[i].kerning);
+
+		delete[] old;
+	}
+
+	FT_Face  m_face;
+	FT_UInt *m_index;   // glyph indices of the dense table's characters
+	VGfloat *m_dense[KERNING_DENSE_CHARS]; // rows by left character
 
-	cVector<tKerning> m_kerningCache;
+	tPair *m_hash;
+	int m_hashSize;
+	int m_hashCount;
+
+	cOvgKerningTable(const cOvgKerningTable&);
+	cOvgKerningTable& operator= (const cOvgKerningTable&);
 };
 
 /* ------------------------------------------------------------------------- */
 
-#define CHAR_HEIGHT (1 << 14)
-
-class cOvgFont : public cListObject
+/*
+ * Fonts are identified by IDs, which are interned from the font's file name
+ * by the drawing threads, so the render thread can look up a font by index.
+ * IDs are never released, since only a handful of fonts is used anyway.
+ */
+class cOvgFont
 {
 public:
 
-	static cOvgFont *Get(const char *name)
+	// get ID of font, -1 if too many fonts are in use
+	static int Id(const char *name)
+	{
+		uint32_t hash = 2166136261u;
+		for (const char *c = name; *c; c++)
+			hash = (hash ^ (unsigned char)*c) * 16777619u;
+
+		int id = -1;
+		s_idMutex.Lock();
+
+		int i = hash & (OVG_FONT_HASH_SIZE - 1);
+		for (; s_ids[i]; i = (i + 1) & (OVG_FONT_HASH_SIZE - 1))
+			if (!strcmp(s_names[s_ids[i] - 1], name))
+			{
+				id = s_ids[i] - 1;
+				break;
+			}
+
+		if (id < 0)
+		{
+			if (s_numIds < OVG_MAX_FONTS)
+			{
+				id = s_numIds++;
+				s_names[id] = name;
+				s_ids[i] = id + 1;
+			}
+			else
+				ELOG("[OpenVG] too many fonts, can't use %s!", name);
+		}
+
+		s_idMutex.Unlock();
+		return id;
+	}
+
+	static cOvgFont *Get(int id)
 	{
-		if (!s_fonts)
+		if (id < 0 || id >= OVG_MAX_FONTS)
+			return 0;
+
+		if (!s_ftLib)
 			Init();
 
-		cOvgFont *font;
-		for (font = s_fonts->First(); font; font = s_fonts->Next(font))
-			if (!strcmp(font->Name(), name))
-				return font;
+		if (s_fonts[id])
+			return s_fonts[id];
 
-		font = 0;
+		// the name has been set before the ID was passed to the render thread
+		const char *name = s_names[id];
+		cOvgFont *font = 0;
 		bool retry = true;
 		while (!font)
 		{
@@ -120,7 +418,7 @@ public:
 			{
 				delete font;
 				font = 0;
-				s_fonts->Clear();
+				DropAll();
 				if (!retry)
 				{
 					ELOG("[OpenVG] out of memory - failed to load font!");
@@ -130,14 +428,27 @@ public:
 				retry = false;
 			}
 		}
-		s_fonts->Add(font);
+		s_fonts[id] = font;
 		return font;
 	}
 
+	// load font and convert its Latin-1 glyphs in advance
+	static void Preload(int id)
+	{
+		cOvgFont *font = Get(id);
+		if (!font || font->m_font == VG_INVALID_HANDLE)
+			return;
+
+		for (uint ch = 0x20; ch <= 0xff; ch++)
+			if (ch < 0x7f || ch >= 0xa0)
+				font->Glyph(ch);
+
+		DLOG("[OpenVG] preloaded %s", font->Name());
+	}
+
 	static void CleanUp(void)
 	{
-		delete s_fonts;
-		s_fonts = 0;
+		DropAll();
 
 		if (FT_Done_FreeType(s_ftLib))
 			ELOG("failed to deinitialize FreeType library!");
@@ -146,37 +457,35 @@ public:
 
 	cOvgGlyph* Glyph(uint charCode) const
 	{
-		cOvgGlyph *glyph = 0;
-		for (glyph = m_glyphs.First(); glyph; glyph = m_glyphs.Next(glyph))
-			if (glyph->CharCode() == charCode)
-				return glyph;
-
-		glyph = ConvertChar(charCode);
-		if (glyph)
-			m_glyphs.Add(glyph);
-
+		cOvgGlyph *glyph = m_glyphs.Get(charCode);
+		if (!glyph)
+		{
+			glyph = ConvertChar(charCode);
+			if (glyph)
+				m_glyphs.Add(glyph);
+		}
 		return glyph;
 	}
 
-	VGfloat Kerning(cOvgGlyph *glyph, uint prevSym) const
+	VGfloat Kerning(cOvgGlyph *prev, cOvgGlyph *glyph) const
 	{
 		VGfloat kerning = 0.0f;
-		if (glyph && prevSym)
+		if (m_hasKerning && prev && glyph &&
+				!m_kerning.Get(prev->CharCode(), glyph->CharCode(), kerning))
 		{
-			if (!glyph->GetKerningCache(prevSym, kerning))
-			{
-				FT_Vector delta;
-				FT_UInt cur = FT_Get_Char_Index(m_face,	glyph->CharCode());
-				FT_UInt prev = FT_Get_Char_Index(m_face, prevSym);
-				FT_Get_Kerning(m_face, prev, cur, FT_KERNING_DEFAULT, &delta);
+			FT_Vector delta;
+			FT_Get_Kerning(m_face, prev->Index(), glyph->Index(),
+					FT_KERNING_DEFAULT, &delta);
 
-				kerning = (VGfloat)delta.x / CHAR_HEIGHT;
-				glyph->SetKerningCache(prevSym, kerning);
-			}
+			kerning = (VGfloat)delta.x / CHAR_HEIGHT;
+			m_kerning.Set(prev->CharCode(), glyph->CharCode(), kerning);
 		}
 		return kerning;
 	}
 
+	// laid out string, owned by the font's string cache
+	cOvgString* String(const unsigned int *symbols);
+
 	VGfloat     Height(void)    { return  m_height;    }
 	VGfloat     Descender(void) { return  m_descender; }
 	VGFont      Font(void)      { return  m_font;      }
@@ -189,11 +498,15 @@ private:
 		m_name(""),
 		m_height(0.0f),
 		m_descender(0.0f),
+		m_hasKerning(false),
+		m_strings(0),
 		m_face(0)
 	{ }
 
 	cOvgFont(FT_Library lib, const char *name) :
-		m_name(name)
+		m_name(name),
+		m_hasKerning(false),
+		m_strings(0)
 	{
 		ILOG("loading %s ...", *m_name);
 
@@ -211,6 +524,13 @@ private:
 		m_height = (VGfloat)(m_face->size->metrics.height) / CHAR_HEIGHT;
 		m_descender = (VGfloat)(abs(m_face->size->metrics.descender)) /
 				CHAR_HEIGHT;
+
+		// fonts without kerning information are common, don't bother then
+		if (FT_HAS_KERNING(m_face))
+		{
+			m_kerning.Init(m_face);
+			m_hasKerning = true;
+		}
 #if 0
 		FT_UInt glyphIndex;
 		FT_ULong ch = FT_Get_First_Char(m_face, &glyphIndex);
@@ -231,7 +551,7 @@ private:
 
 			vgSetGlyphToPath(m_font, ch, path, VG_FALSE, origin, esc);
 
-			m_glyphs.Add(new cOvgGlyph(ch, esc[0], esc[1]));
+			m_glyphs.Add(new cOvgGlyph(ch, glyphIndex, esc[0], esc[1]));
 
 			if (path != VG_INVALID_HANDLE)
 				vgDestroyPath(path);
@@ -241,19 +561,23 @@ private:
 #endif
 	}
 
-	~cOvgFont()
-	{
-		vgDestroyFont(m_font);
-		FT_Done_Face(m_face);
-	}
+	~cOvgFont();
 
 	static void Init(void)
 	{
-		s_fonts = new cList<cOvgFont>;
 		if (FT_Init_FreeType(&s_ftLib))
 			ELOG("failed to initialize FreeType library!");
 	}
 
+	static void DropAll(void)
+	{
+		for (int i = 0; i < OVG_MAX_FONTS; i++)
+		{
+			delete s_fonts[i];
+			s_fonts[i] = 0;
+		}
+	}
+
 	cOvgGlyph *ConvertChar(uint charCode) const
 	{
 		FT_UInt glyphIndex = FT_Get_Char_Index(m_face, charCode);
@@ -273,7 +597,7 @@ private:
 		if (path != VG_INVALID_HANDLE)
 			vgDestroyPath(path);
 
-		return new cOvgGlyph(charCode, esc[0], esc[1]);
+		return new cOvgGlyph(charCode, glyphIndex, esc[0], esc[1]);
 	}
 
 	// convert freetype outline to OpenVG path,
@@ -365,16 +689,30 @@ private:
 	VGfloat m_height;
 	VGfloat m_descender;
 
-	mutable cList<cOvgGlyph> m_glyphs;
+	mutable cOvgGlyphTable m_glyphs;
+	mutable cOvgKerningTable m_kerning;
+	bool m_hasKerning;
+
+	cOvgStringCache *m_strings;
 
 	FT_Face m_face;
 
 	static FT_Library s_ftLib;
-	static cList<cOvgFont> *s_fonts;
+	static cOvgFont *s_fonts[OVG_MAX_FONTS];
+
+	static cMutex  s_idMutex;
+	static cString s_names[OVG_MAX_FONTS];
+	static int     s_ids[OVG_FONT_HASH_SIZE]; // ID + 1, 0 if unused
+	static int     s_numIds;
 };
 
 FT_Library cOvgFont::s_ftLib = 0;
-cList<cOvgFont> *cOvgFont::s_fonts = 0;
+cOvgFont *cOvgFont::s_fonts[OVG_MAX_FONTS] = { 0 };
+
+cMutex  cOvgFont::s_idMutex;
+cString cOvgFont::s_names[OVG_MAX_FONTS];
+int     cOvgFont::s_ids[OVG_FONT_HASH_SIZE] = { 0 };
+int     cOvgFont::s_numIds = 0;
 
 /* ------------------------------------------------------------------------- */
 
@@ -386,19 +724,19 @@ public:
 		m_width(0.0f), m_height(font->Height()), m_descender(font->Descender()),
 		m_font(font)
 	{
-		uint prevSym = 0;
+		cOvgGlyph *prev = 0;
 		for (int i = 0; symbols[i]; i++)
 			if (cOvgGlyph *g = font->Glyph(symbols[i]))
 			{
 				VGfloat kerning = 0.0f;
-				if (prevSym)
+				if (prev)
 				{
-					kerning = m_font->Kerning(g, prevSym);
+					kerning = m_font->Kerning(prev, g);
 					m_kerning.push_back(kerning);
 				}
 				m_width += g->AdvanceX() + kerning;
 				m_glyphIds.push_back(symbols[i]);
-				prevSym = symbols[i];
+				prev = g;
 			}
 	}
 
@@ -425,6 +763,140 @@ private:
 
 /* ------------------------------------------------------------------------- */
 
+// LRU cache of laid out strings per font, since skins draw the same labels
+// over and over again. Strings are identified by a hash of their symbols,
+// a string colliding with a cached one simply replaces it.
+
+#define OVG_STRINGCACHE_SIZE 256 // strings per font
+
+class cOvgStringCache
+{
+public:
+
+	cOvgStringCache() { }
+
+	~cOvgStringCache()
+	{
+		for (std::list<tEntry*>::iterator it = m_lru.begin();
+				it != m_lru.end(); ++it)
+		{
+			delete (*it)->string;
+			delete *it;
+		}
+	}
+
+	cOvgString* Get(const unsigned int *symbols, cOvgFont *font)
+	{
+		uint32_t hash = Hash(symbols);
+		std::map<uint32_t, std::list<tEntry*>::iterator>::iterator it =
+				m_index.find(hash);
+
+		if (it != m_index.end())
+		{
+			tEntry *entry = *it->second;
+			if (Equals(entry->symbols, symbols))
+			{
+				m_lru.splice(m_lru.begin(), m_lru, it->second);
+				s_hits++;
+				return entry->string;
+			}
+			Remove(it);
+		}
+		else if (m_index.size() >= OVG_STRINGCACHE_SIZE)
+			Remove(m_index.find(m_lru.back()->hash));
+
+		s_misses++;
+
+		tEntry *entry = new tEntry;
+		entry->hash = hash;
+		for (int i = 0; symbols[i]; i++)
+			entry->symbols.push_back(symbols[i]);
+		entry->symbols.push_back(0);
+		entry->string = new cOvgString(symbols, font);
+
+		m_lru.push_front(entry);
+		m_index[hash] = m_lru.begin();
+		return entry->string;
+	}
+
+	// hit and miss count of all string caches since last call
+	static void GetStats(int &hits, int &misses, bool reset)
+	{
+		hits = s_hits;
+		misses = s_misses;
+		if (reset)
+		{
+			s_hits = 0;
+			s_misses = 0;
+		}
+	}
+
+private:
+
+	struct tEntry
+	{
+		uint32_t hash;
+		std::vector<unsigned int> symbols;
+		cOvgString *string;
+	};
+
+	// FNV-1a
+	static uint32_t Hash(const unsigned int *symbols)
+	{
+		uint32_t hash = 2166136261u;
+		for (int i = 0; symbols[i]; i++)
+			hash = (hash ^ symbols[i]) * 16777619u;
+		return hash;
+	}
+
+	static bool Equals(const std::vector<unsigned int> &a,
+			const unsigned int *b)
+	{
+		for (unsigned int i = 0; i < a.size(); i++)
+			if (a[i] != b[i])
+				return false;
+		return true;
+	}
+
+	void Remove(std::map<uint32_t, std::list<tEntry*>::iterator>::iterator it)
+	{
+		tEntry *entry = *it->second;
+		m_lru.erase(it->second);
+		m_index.erase(it);
+		delete entry->string;
+		delete entry;
+	}
+
+	std::list<tEntry*> m_lru;
+	std::map<uint32_t, std::list<tEntry*>::iterator> m_index;
+
+	static int s_hits;
+	static int s_misses;
+
+	cOvgStringCache(const cOvgStringCache&);
+	cOvgStringCache& operator= (const cOvgStringCache&);
+};
+
+int cOvgStringCache::s_hits = 0;
+int cOvgStringCache::s_misses = 0;
+
+cOvgFont::~cOvgFont()
+{
+	delete m_strings;
+	vgDestroyFont(m_font);
+	FT_Done_Face(m_face);
+}
+
+cOvgString* cOvgFont::String(const unsigned int *symbols)
+{
+	if (!m_strings)
+		m_strings = new cOvgStringCache();
+
+	return m_strings->Get(symbols, this);
+}
+
+/* ------------------------------------------------------------------------- */
+
 class cOvgPaintBox
 {
 public:
@@ -661,92 +1133,759 @@ public:
 				error == EGL_CONTEXT_LOST        ? "context lost"        :
 						"unknown error";
 	}
-};
+};
+
+/* ------------------------------------------------------------------------- */
+
+struct tOvgImageRef
+{
+	VGImage image;
+	bool used;
+};
+
+/* ------------------------------------------------------------------------- */
+
+class cOvgSavedRegion
+{
+public:
+
+	cOvgSavedRegion() : image(VG_INVALID_HANDLE), rect(cRect()) { }
+	VGImage image;
+	cRect rect;
+};
+
+/* ------------------------------------------------------------------------- */
+
+class cOvgRenderTarget
+{
+public:
+
+	cOvgRenderTarget(int _width = 0, int _height = 0) :
+		surface(EGL_NO_SURFACE),
+		image(VG_INVALID_HANDLE),
+		width(_width),
+		height(_height),
+		initialized(false) { }
+
+	virtual ~cOvgRenderTarget() { }
+
+	static bool MakeDefault(cEgl *egl)
+	{
+		if (eglMakeCurrent(egl->display, egl->surface, egl->surface,
+				egl->context) == EGL_FALSE)
+		{
+			ELOG("[EGL] failed to connect context to surface: %s!",
+					cEgl::errStr(eglGetError()));
+			return false;
+		}
+		egl->currentSurface = egl->surface;
+		return true;
+	}
+
+	virtual bool MakeCurrent(cEgl *egl)
+	{
+		// if this is a window surface, check for an update after OSD reset
+		if (image == VG_INVALID_HANDLE && surface != egl->surface)
+		{
+			surface = egl->surface;
+			width = egl->window.width;
+			height = egl->window.height;
+		}
+
+		if (egl->currentSurface == surface)
+			return true;
+
+		if (eglMakeCurrent(egl->display, surface, surface, egl->context) ==
+				EGL_FALSE)
+		{
+			ELOG("[EGL] failed to connect context to surface: %s!",
+					cEgl::errStr(eglGetError()));
+			return false;
+		}
+		egl->currentSurface = surface;
+		return true;
+	}
+
+	EGLSurface surface;
+	VGImage    image;
+	int        width;
+	int        height;
+	bool       initialized;
+
+private:
+
+	cOvgRenderTarget(const cOvgRenderTarget&);
+	cOvgRenderTarget& operator= (const cOvgRenderTarget&);
+};
+
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Cache of text runs rendered into images, since drawing glyphs requires
+ * their outlines to be tessellated with every draw, which is expensive on
+ * the smaller Pis. A run is identified by its symbols, font, size, color and
+ * sub-pixel position quantized to a quarter pixel. Only runs drawn at least
+ * twice are rendered into an image, which happens in a scratch pixel buffer
+ * the run is copied from. Images are evicted in LRU order once the memory
+ * budget given by cRpiSetup::TextCacheSize() is exceeded, which includes the
+ * scratch pixel buffer.
+ */
+
+#define OVG_TEXTCACHE_SCRATCH_W 1024
+#define OVG_TEXTCACHE_SCRATCH_H 128
+#define OVG_TEXTCACHE_RUNS      1024 // incl. runs seen only once
+#define OVG_TEXTCACHE_PHASES    4    // sub-pixel positions per pixel
+
+class cOvgTextCache
+{
+public:
+
+	// get image of text run to be drawn at surface position x, y, where the
+	// image has to be placed at ix, iy. the current surface is changed!
+	static bool Get(cEgl *egl, int fontId, const unsigned int *symbols,
+			cOvgString *string, int fontSize, tColor color, VGfloat x, VGfloat y,
+			VGImage &image, VGfloat &ix, VGfloat &iy)
+	{
+		// glyphs are drawn with the source's alpha, which can't be reproduced
+		// by blending an image for translucent colors
+		int budget = cRpiSetup::TextCacheSize() * 1024 - (int)(
+				OVG_TEXTCACHE_SCRATCH_W * OVG_TEXTCACHE_SCRATCH_H * sizeof(tColor));
+		if (budget <= 0 || !string->Length() || (color >> 24) != 0xff)
+			return false;
+
+		int phaseX = (int)((x - floor(x)) * OVG_TEXTCACHE_PHASES);
+		int phaseY = (int)((y - floor(y)) * OVG_TEXTCACHE_PHASES);
+
+		// size of run including some space for overhanging glyphs
+		int margin = fontSize / 4 + 1;
+		int below = (int)ceil(string->Descender() * fontSize) + margin;
+		int w = (int)ceil(string->Width() * fontSize) + 2 * margin + 1;
+		int h = (int)ceil(string->Height() * fontSize) + 2 * margin + 1;
+
+		if (w > OVG_TEXTCACHE_SCRATCH_W || h > OVG_TEXTCACHE_SCRATCH_H ||
+				w * h * 4 > budget)
+			return false;
+
+		uint32_t hash = 2166136261u;
+		for (int i = 0; symbols[i]; i++)
+			hash = (hash ^ symbols[i]) * 16777619u;
+		hash = (hash ^ fontId) * 16777619u;
+		hash = (hash ^ fontSize) * 16777619u;
+		hash = (hash ^ color) * 16777619u;
+		hash = (hash ^ (phaseX * OVG_TEXTCACHE_PHASES + phaseY)) * 16777619u;
+
+		tRun *run = 0;
+		std::map<uint32_t, std::list<tRun*>::iterator>::iterator it =
+				s_index.find(hash);
+
+		if (it != s_index.end())
+		{
+			run = *it->second;
+			if (run->fontSize == fontSize && run->color == color &&
+					run->phase == phaseX * OVG_TEXTCACHE_PHASES + phaseY &&
+					run->fontId == fontId &&
+					Equals(run->symbols, symbols))
+				s_lru.splice(s_lru.begin(), s_lru, it->second);
+			else
+			{
+				Remove(it);
+				run = 0;
+			}
+		}
+
+		if (!run)
+		{
+			// remember run, but only render it when it's used again
+			if (s_index.size() >= OVG_TEXTCACHE_RUNS)
+				Remove(s_index.find(s_lru.back()->hash));
+
+			run = new tRun;
+			run->hash = hash;
+			for (int i = 0; symbols[i]; i++)
+				run->symbols.push_back(symbols[i]);
+			run->symbols.push_back(0);
+			run->fontId = fontId;
+			run->fontSize = fontSize;
+			run->color = color;
+			run->phase = phaseX * OVG_TEXTCACHE_PHASES + phaseY;
+			run->image = VG_INVALID_HANDLE;
+			run->bytes = 0;
+
+			s_lru.push_front(run);
+			s_index[hash] = s_lru.begin();
+			return false;
+		}
+
+		if (run->image == VG_INVALID_HANDLE)
+		{
+			while (s_bytes + w * h * 4 > budget && Evict()) { }
+
+			if (!Render(egl, run, string, w, h, margin, below,
+					(VGfloat)phaseX / OVG_TEXTCACHE_PHASES,
+					(VGfloat)phaseY / OVG_TEXTCACHE_PHASES))
+				return false;
+
+			run->left = margin;
+			run->below = below;
+			s_rendered++;
+		}
+		else
+			s_hits++;
+
+		image = run->image;
+		ix = floor(x) - run->left;
+		iy = floor(y) - run->below;
+		return true;
+	}
+
+	static void Draw(VGImage image, VGfloat x, VGfloat y)
+	{
+		vgSeti(VG_MATRIX_MODE, VG_MATRIX_IMAGE_USER_TO_SURFACE);
+		vgSeti(VG_IMAGE_MODE, VG_DRAW_IMAGE_NORMAL);
+		vgSeti(VG_IMAGE_QUALITY, VG_IMAGE_QUALITY_NONANTIALIASED);
+		vgSeti(VG_BLEND_MODE, VG_BLEND_SRC_OVER);
+
+		vgLoadIdentity();
+		vgTranslate(x, y);
+		vgDrawImage(image);
+	}
+
+	static void CleanUp(cEgl *egl)
+	{
+		while (!s_lru.empty())
+			Remove(s_index.find(s_lru.back()->hash));
+
+		if (s_scratch.surface != EGL_NO_SURFACE)
+		{
+			eglDestroySurface(egl->display, s_scratch.surface);
+			vgDestroyImage(s_scratch.image);
+			s_scratch.surface = EGL_NO_SURFACE;
+			s_scratch.image = VG_INVALID_HANDLE;
+		}
+		s_scratch.initialized = false;
+	}
+
+	// hits and runs rendered since last call, current memory usage
+	static void GetStats(int &hits, int &rendered, int &bytes, bool reset)
+	{
+		hits = s_hits;
+		rendered = s_rendered;
+		bytes = s_bytes;
+		if (reset)
+		{
+			s_hits = 0;
+			s_rendered = 0;
+		}
+	}
+
+private:
+
+	struct tRun
+	{
+		uint32_t hash;
+		std::vector<unsigned int> symbols;
+		int fontId;
+		int fontSize;
+		tColor color;
+		int phase;
+		VGImage image; // invalid if not rendered yet
+		int bytes;
+		int left;      // position of text origin within image
+		int below;
+	};
+
+	static bool Equals(const std::vector<unsigned int> &a,
+			const unsigned int *b)
+	{
+		for (unsigned int i = 0; i < a.size(); i++)
+			if (a[i] != b[i])
+				return false;
+		return true;
+	}
+
+	static bool Render(cEgl *egl, tRun *run, cOvgString *string, int w, int h,
+			int left, int below, VGfloat phaseX, VGfloat phaseY)
+	{
+		if (!s_scratch.initialized)
+		{
+			s_scratch.initialized = true;
+			s_scratch.image = vgCreateImage(VG_sARGB_8888, s_scratch.width,
+					s_scratch.height, VG_IMAGE_QUALITY_BETTER);
+			if (s_scratch.image != VG_INVALID_HANDLE)
+			{
+				s_scratch.surface = eglCreatePbufferFromClientBuffer(
+						egl->display, EGL_OPENVG_IMAGE,
+						(EGLClientBuffer)s_scratch.image, egl->config, NULL);
+				if (s_scratch.surface == EGL_NO_SURFACE)
+				{
+					vgDestroyImage(s_scratch.image);
+					s_scratch.image = VG_INVALID_HANDLE;
+				}
+			}
+			if (s_scratch.surface == EGL_NO_SURFACE)
+				ELOG("[OpenVG] failed to allocate text cache, "
+						"drawing glyphs directly!");
+		}
+		if (s_scratch.surface == EGL_NO_SURFACE ||
+				!s_scratch.MakeCurrent(egl))
+			return false;
+
+		run->image = vgCreateImage(VG_sARGB_8888, w, h,
+				VG_IMAGE_QUALITY_NONANTIALIASED);
+		if (run->image == VG_INVALID_HANDLE)
+			return false;
+
+		run->bytes = w * h * 4;
+		s_bytes += run->bytes;
+
+		VGfloat transparent[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		vgSetfv(VG_CLEAR_COLOR, 4, transparent);
+		cOvgPaintBox::SetScissoring();
+		vgClear(0, 0, w, h);
+
+		vgSeti(VG_BLEND_MODE, VG_BLEND_SRC);
+		vgSeti(VG_MATRIX_MODE, VG_MATRIX_GLYPH_USER_TO_SURFACE);
+		vgLoadIdentity();
+		vgTranslate(left + phaseX, below + phaseY);
+		vgScale(run->fontSize, run->fontSize);
+
+		VGfloat origin[2] = { 0.0f, 0.0f };
+		vgSetfv(VG_GLYPH_ORIGIN, 2, origin);
+
+		cOvgPaintBox::SetColor(run->color);
+		cOvgPaintBox::Draw(string);
+
+		vgGetPixels(run->image, 0, 0, 0, 0, w, h);
+		return true;
+	}
+
+	// drop least recently used image, false if there's none left
+	static bool Evict(void)
+	{
+		for (std::list<tRun*>::reverse_iterator it = s_lru.rbegin();
+				it != s_lru.rend(); ++it)
+			if ((*it)->image != VG_INVALID_HANDLE)
+			{
+				vgDestroyImage((*it)->image);
+				(*it)->image = VG_INVALID_HANDLE;
+				s_bytes -= (*it)->bytes;
+				(*it)->bytes = 0;
+				return true;
+			}
+		return false;
+	}
+
+	static void Remove(std::map<uint32_t, std::list<tRun*>::iterator>::iterator it)
+	{
+		tRun *run = *it->second;
+		if (run->image != VG_INVALID_HANDLE)
+		{
+			vgDestroyImage(run->image);
+			s_bytes -= run->bytes;
+		}
+		s_lru.erase(it->second);
+		s_index.erase(it);
+		delete run;
+	}
+
+	static std::list<tRun*> s_lru;
+	static std::map<uint32_t, std::list<tRun*>::iterator> s_index;
+
+	static cOvgRenderTarget s_scratch;
+
+	static int s_bytes;
+	static int s_hits;
+	static int s_rendered;
+};
+
+std::list<cOvgTextCache::tRun*> cOvgTextCache::s_lru;
+std::map<uint32_t, std::list<cOvgTextCache::tRun*>::iterator>
+		cOvgTextCache::s_index;
+
+cOvgRenderTarget cOvgTextCache::s_scratch(OVG_TEXTCACHE_SCRATCH_W,
+		OVG_TEXTCACHE_SCRATCH_H);
+
+int cOvgTextCache::s_bytes = 0;
+int cOvgTextCache::s_hits = 0;
+int cOvgTextCache::s_rendered = 0;
+
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Pool of images for drawing bitmaps, owned by the render thread. Allocating
+ * an image on the VideoCore takes much longer than uploading its pixels, so
+ * images are kept after being drawn and used again for bitmaps of the same
+ * size class, where each dimension is rounded up to 1/16 of its next power of
+ * two. A child image of the requested size is handed out, which is kept as
+ * well, since bitmaps of one kind (logos, icons, dirty regions of the raw
+ * OSD) tend to have the same size. At least two images are used in turn per
+ * size class, so an image isn't overwritten while a draw of its previous
+ * content may still be pending. Images unused for OVG_IMAGEPOOL_IDLE ms are
+ * freed while the render thread is idle, all of them on reset.
+ */
+
+#define OVG_IMAGEPOOL_IMAGES 32
+#define OVG_IMAGEPOOL_SIZE   MEGABYTE(16) // kept images
+#define OVG_IMAGEPOOL_IDLE   5000         // ms
+
+class cOvgImagePool
+{
+public:
+
+	// image of w x h px, valid until the next call
+	static VGImage Get(int w, int h)
+	{
+		int maxW = vgGeti(VG_MAX_IMAGE_WIDTH);
+		int maxH = vgGeti(VG_MAX_IMAGE_HEIGHT);
+		if (w <= 0 || h <= 0 || w > maxW || h > maxH)
+			return VG_INVALID_HANDLE;
+
+		int cw = std::min(SizeClass(w), maxW);
+		int ch = std::min(SizeClass(h), maxH);
+
+		// the most recently used image of this size class is skipped
+		tImage *latest = 0;
+		int images = 0;
+		for (int i = 0; i < OVG_IMAGEPOOL_IMAGES; i++)
+			if (s_images[i].parent != VG_INVALID_HANDLE &&
+					s_images[i].w == cw && s_images[i].h == ch)
+			{
+				images++;
+				if (!latest || s_images[i].use > latest->use)
+					latest = &s_images[i];
+			}
+
+		// prefer an image with a child of the right size
+		tImage *image = 0;
+		if (images >= 2)
+			for (int i = 0; i < OVG_IMAGEPOOL_IMAGES; i++)
+				if (s_images[i].parent != VG_INVALID_HANDLE &&
+						s_images[i].w == cw && s_images[i].h == ch &&
+						&s_images[i] != latest)
+				{
+					image = &s_images[i];
+					if (image->childW == w && image->childH == h)
+						break;
+				}
+
+		if (image)
+			s_reuses++;
+		else
+		{
+			int bytes = cw * ch * sizeof(tColor);
+			while (s_bytes + bytes > OVG_IMAGEPOOL_SIZE && Evict())
+				;
+
+			while (!(image = Unused()) && Evict())
+				;
+
+			image->parent = Create(cw, ch);
+
+			// make room for it in GPU memory
+			if (image->parent == VG_INVALID_HANDLE)
+			{
+				Trim(true);
+				image->parent = Create(cw, ch);
+			}
+
+			if (image->parent == VG_INVALID_HANDLE)
+				return VG_INVALID_HANDLE;
+
+			image->w = cw;
+			image->h = ch;
+			s_bytes += bytes;
+		}
+		image->lastUsed = cTimeMs::Now();
+		image->use = ++s_uses;
+
+		if (w == cw && h == ch)
+			return image->parent;
+
+		if (image->childW != w || image->childH != h)
+		{
+			if (image->child != VG_INVALID_HANDLE)
+				vgDestroyImage(image->child);
+
+			image->child = vgChildImage(image->parent, 0, 0, w, h);
+			image->childW = image->child != VG_INVALID_HANDLE ? w : 0;
+			image->childH = image->child != VG_INVALID_HANDLE ? h : 0;
+		}
+		return image->child;
+	}
+
+	// free images unused for some time, or all of them
+	static void Trim(bool all = false)
+	{
+		uint64_t now = cTimeMs::Now();
+		for (int i = 0; i < OVG_IMAGEPOOL_IMAGES; i++)
+			if (s_images[i].parent != VG_INVALID_HANDLE &&
+					(all || now - s_images[i].lastUsed > OVG_IMAGEPOOL_IDLE))
+				Free(&s_images[i]);
+	}
+
+	// allocations and reuses since last call, time spent for allocations in
+	// us and current memory usage
+	static void GetStats(int &allocs, int &reuses, int &allocTime,
+			int &bytes, bool reset)
+	{
+		allocs = s_allocs;
+		reuses = s_reuses;
+		allocTime = s_allocTime;
+		bytes = s_bytes;
+		if (reset)
+		{
+			s_allocs = 0;
+			s_reuses = 0;
+			s_allocTime = 0;
+		}
+	}
+
+private:
+
+	struct tImage
+	{
+		VGImage  parent;
+		VGImage  child;
+		int      w;
+		int      h;
+		int      childW;
+		int      childH;
+		uint64_t lastUsed;
+		uint64_t use;
+	};
+
+	static int SizeClass(int size)
+	{
+		int pow2 = 16;
+		while (pow2 < size)
+			pow2 <<= 1;
+
+		int step = std::max(pow2 / 16, 16);
+		return (size + step - 1) / step * step;
+	}
+
+	static VGImage Create(int w, int h)
+	{
+		uint64_t start = cTimeUs::Now();
+		VGImage image = vgCreateImage(VG_sARGB_8888, w, h,
+				VG_IMAGE_QUALITY_BETTER);
+		s_allocTime += cTimeUs::Now() - start;
+		s_allocs++;
+		return image;
+	}
+
+	static tImage *Unused(void)
+	{
+		for (int i = 0; i < OVG_IMAGEPOOL_IMAGES; i++)
+			if (s_images[i].parent == VG_INVALID_HANDLE)
+				return &s_images[i];
+		return 0;
+	}
+
+	static void Free(tImage *image)
+	{
+		if (image->child != VG_INVALID_HANDLE)
+			vgDestroyImage(image->child);
+		vgDestroyImage(image->parent);
+
+		s_bytes -= image->w * image->h * sizeof(tColor);
+		image->parent = VG_INVALID_HANDLE;
+		image->child = VG_INVALID_HANDLE;
+		image->childW = image->childH = 0;
+	}
 
-/* ------------------------------------------------------------------------- */
+	// free least recently used image, false if there's none left
+	static bool Evict(void)
+	{
+		tImage *lru = 0;
+		for (int i = 0; i < OVG_IMAGEPOOL_IMAGES; i++)
+			if (s_images[i].parent != VG_INVALID_HANDLE &&
+					(!lru || s_images[i].lastUsed < lru->lastUsed))
+				lru = &s_images[i];
+
+		if (lru)
+			Free(lru);
+		return lru != 0;
+	}
 
-struct tOvgImageRef
-{
-	VGImage image;
-	bool used;
-};
+	static tImage s_images[OVG_IMAGEPOOL_IMAGES];
+	static uint64_t s_uses;
 
-/* ------------------------------------------------------------------------- */
+	static int s_bytes;
+	static int s_allocs;
+	static int s_reuses;
+	static int s_allocTime;
+};
 
-class cOvgSavedRegion
-{
-public:
+// zero initialized, which is VG_INVALID_HANDLE
+cOvgImagePool::tImage cOvgImagePool::s_images[OVG_IMAGEPOOL_IMAGES];
+uint64_t cOvgImagePool::s_uses = 0;
 
-	cOvgSavedRegion() : image(VG_INVALID_HANDLE), rect(cRect()) { }
-	VGImage image;
-	cRect rect;
-};
+int cOvgImagePool::s_bytes = 0;
+int cOvgImagePool::s_allocs = 0;
+int cOvgImagePool::s_reuses = 0;
+int cOvgImagePool::s_allocTime = 0;
 
 /* ------------------------------------------------------------------------- */
 
-class cOvgRenderTarget
+// commands and their payload are allocated from arenas, which are recycled
+// as soon as all of their commands have been executed by the render thread
+
+#define OVG_ARENA_BLOCKSIZE  KILOBYTE(128)
+#define OVG_ARENA_KEEPBLOCKS 4
+#define OVG_ARENA_ALIGN(x)   (((x) + 7) & ~(size_t)7)
+
+class cOvgCmdArena
 {
 public:
 
-	cOvgRenderTarget(int _width = 0, int _height = 0) :
-		surface(EGL_NO_SURFACE),
-		image(VG_INVALID_HANDLE),
-		width(_width),
-		height(_height),
-		initialized(false) { }
-
-	virtual ~cOvgRenderTarget() { }
+	cOvgCmdArena() :
+		m_pending(0), m_sealed(false), m_next(0), m_first(0), m_current(0),
+		m_oversized(0)
+	{ }
 
-	static bool MakeDefault(cEgl *egl)
+	~cOvgCmdArena()
 	{
-		if (eglMakeCurrent(egl->display, egl->surface, egl->surface,
-				egl->context) == EGL_FALSE)
+		while (Block *block = m_first)
 		{
-			ELOG("[EGL] failed to connect context to surface: %s!",
-					cEgl::errStr(eglGetError()));
-			return false;
+			m_first = block->next;
+			free(block);
 		}
-		egl->currentSurface = egl->surface;
-		return true;
 	}
 
-	virtual bool MakeCurrent(cEgl *egl)
+	void *Alloc(size_t size)
 	{
-		// if this is a window surface, check for an update after OSD reset
-		if (image == VG_INVALID_HANDLE && surface != egl->surface)
+		size = OVG_ARENA_ALIGN(size);
+
+		// oversized payload gets a block on its own
+		if (size > OVG_ARENA_BLOCKSIZE)
 		{
-			surface = egl->surface;
-			width = egl->window.width;
-			height = egl->window.height;
+			Block *block = NewBlock(size);
+			if (!block)
+				return 0;
+
+			block->used = size;
+			block->next = m_first;
+			m_first = block;
+			m_oversized++;
+			return Payload(block);
 		}
 
-		if (egl->currentSurface == surface)
-			return true;
+		// continue with blocks kept from previous cycles
+		while (m_current && m_current->used + size > m_current->size &&
+				m_current->next)
+			m_current = m_current->next;
 
-		if (eglMakeCurrent(egl->display, surface, surface, egl->context) ==
-				EGL_FALSE)
+		if (!m_current || m_current->used + size > m_current->size)
 		{
-			ELOG("[EGL] failed to connect context to surface: %s!",
-					cEgl::errStr(eglGetError()));
-			return false;
+			Block *block = NewBlock(OVG_ARENA_BLOCKSIZE);
+			if (!block)
+				return 0;
+
+			if (m_current)
+			{
+				block->next = m_current->next;
+				m_current->next = block;
+			}
+			else
+			{
+				block->next = m_first;
+				m_first = block;
+			}
+			m_current = block;
 		}
-		egl->currentSurface = surface;
-		return true;
+
+		void *p = Payload(m_current) + m_current->used;
+		m_current->used += size;
+		return p;
 	}
 
-	EGLSurface surface;
-	VGImage    image;
-	int        width;
-	int        height;
-	bool       initialized;
+	// free an oversized block as soon as its command has been executed,
+	// instead of keeping it until the arena is recycled
+	void Free(void *p)
+	{
+		if (!m_oversized)
+			return;
+
+		for (Block **link = &m_first; *link; link = &(*link)->next)
+			if (Payload(*link) == p)
+			{
+				Block *block = *link;
+				if (block->size > OVG_ARENA_BLOCKSIZE)
+				{
+					*link = block->next;
+					free(block);
+					m_oversized--;
+				}
+				return;
+			}
+	}
+
+	void Recycle(void)
+	{
+		// keep some regular blocks for the next cycle, free the others
+		int kept = 0;
+		Block **link = &m_first;
+		while (Block *block = *link)
+		{
+			if (block->size == OVG_ARENA_BLOCKSIZE &&
+					kept < OVG_ARENA_KEEPBLOCKS)
+			{
+				block->used = 0;
+				link = &block->next;
+				kept++;
+			}
+			else
+			{
+				*link = block->next;
+				free(block);
+			}
+		}
+		m_current = m_first;
+		m_pending = 0;
+		m_sealed = false;
+		m_oversized = 0;
+	}
+
+	int           m_pending; // commands allocated, but not yet executed
+	bool          m_sealed;  // no further commands will be allocated
+	cOvgCmdArena *m_next;
 
 private:
 
-	cOvgRenderTarget(const cOvgRenderTarget&);
-	cOvgRenderTarget& operator= (const cOvgRenderTarget&);
+	struct Block
+	{
+		Block *next;
+		size_t size;
+		size_t used;
+	};
+
+	static Block *NewBlock(size_t size)
+	{
+		Block *block = (Block *)malloc(OVG_ARENA_ALIGN(sizeof(Block)) + size);
+		if (block)
+		{
+			block->next = 0;
+			block->size = size;
+			block->used = 0;
+		}
+		return block;
+	}
+
+	static unsigned char *Payload(Block *block)
+	{
+		return (unsigned char *)block + OVG_ARENA_ALIGN(sizeof(Block));
+	}
+
+	Block *m_first;
+	Block *m_current;
+	int    m_oversized;
+
+	cOvgCmdArena(const cOvgCmdArena&);
+	cOvgCmdArena& operator= (const cOvgCmdArena&);
 };
 
-/* ------------------------------------------------------------------------- */
+class cOvgThread;
 
 class cOvgCmd
 {
@@ -759,12 +1898,39 @@ public:
 	virtual const char* Description(void) = 0;
 	virtual bool IsFlush(void) { return false; };
 
+	// commands are placed in the current arena of the render thread, with
+	// 'data' bytes of trailing space for their payload, see Data(). Returns
+	// 0 if out of memory, the command is destroyed after its execution.
+	static void *operator new(size_t size, cOvgThread *ovg, size_t data = 0)
+		throw();
+	static void operator delete(void *p, cOvgThread *ovg, size_t data) { }
+	static void operator delete(void *p) { }
+
+	void *Data(void) { return (unsigned char *)this + GetHeader()->size; }
+	cOvgCmdArena *Arena(void) { return GetHeader()->arena; }
+
+	// start of the memory allocated for the command
+	void *Allocation(void) { return GetHeader(); }
+
 protected:
 
 	cOvgRenderTarget *m_target;
 
 private:
 
+	struct Header
+	{
+		cOvgCmdArena *arena;
+		size_t        size;
+	};
+
+	static size_t HeaderSize(void) { return OVG_ARENA_ALIGN(sizeof(Header)); }
+
+	Header *GetHeader(void)
+	{
+		return (Header *)((unsigned char *)this - HeaderSize());
+	}
+
 	cOvgCmd(const cOvgCmd&);
 	cOvgCmd& operator= (const cOvgCmd&);
 };
@@ -800,8 +1966,10 @@ public:
 
 	virtual bool Execute(cEgl *egl)
 	{
+		cOvgImagePool::Trim(true);
 		if (m_cleanup)
 		{
+			cOvgTextCache::CleanUp(egl);
 			cOvgFont::CleanUp();
 			cOvgPaintBox::CleanUp();
 		}
@@ -813,6 +1981,26 @@ private:
 	bool m_cleanup;
 };
 
+class cOvgCmdPreloadFont : public cOvgCmd
+{
+public:
+
+	cOvgCmdPreloadFont(int fontId) :
+		cOvgCmd(0), m_fontId(fontId) { }
+
+	virtual const char* Description(void) { return "PreloadFont"; }
+
+	virtual bool Execute(cEgl *egl)
+	{
+		cOvgFont::Preload(m_fontId);
+		return true;
+	}
+
+private:
+
+	int m_fontId;
+};
+
 class cOvgCmdCreatePixelBuffer : public cOvgCmd
 {
 public:
@@ -890,8 +2078,10 @@ class cOvgCmdClear : public cOvgCmd
 {
 public:
 
-	cOvgCmdClear(cOvgRenderTarget *target, tColor color = clrTransparent) :
-		cOvgCmd(target), m_color(color) { }
+	// clear given area or entire target if rect is empty
+	cOvgCmdClear(cOvgRenderTarget *target, tColor color = clrTransparent,
+			const cRect &rect = cRect::Null) :
+		cOvgCmd(target), m_color(color), m_rect(rect) { }
 
 	virtual const char* Description(void) { return "Clear"; }
 
@@ -908,13 +2098,18 @@ public:
 		};
 
 	    vgSetfv(VG_CLEAR_COLOR, 4, color);
-	    vgClear(0, 0, m_target->width, m_target->height);
+	    if (m_rect.IsEmpty())
+			vgClear(0, 0, m_target->width, m_target->height);
+	    else
+			vgClear(m_rect.X(), m_target->height - m_rect.Y() - m_rect.Height(),
+					m_rect.Width(), m_rect.Height());
 		return true;
 	}
 
 private:
 
 	tColor m_color;
+	cRect m_rect;
 };
 
 class cOvgCmdSaveRegion : public cOvgCmd
@@ -1171,18 +2366,21 @@ class cOvgCmdDrawText : public cOvgCmd
 {
 public:
 
-	cOvgCmdDrawText(cOvgRenderTarget *target,
-			int x, int y, unsigned int *symbols, cString *fontName,
-			int fontSize, tColor colorFg,	tColor colorBg, int w, int h,
-			int alignment) :
-		cOvgCmd(target), m_x(x), m_y(y), m_w(w), m_h(h),
-		m_symbols(symbols), m_fontName(fontName), m_fontSize(fontSize),
-		m_colorFg(colorFg), m_colorBg(colorBg),	m_alignment(alignment) { }
+	// symbols are kept in the command's data
+	static size_t DataSize(int len)
+	{
+		return sizeof(unsigned int) * (len + 1);
+	}
 
-	virtual ~cOvgCmdDrawText()
+	cOvgCmdDrawText(cOvgRenderTarget *target, int x, int y, const char *s,
+			int len, int fontId, int fontSize, tColor colorFg,
+			tColor colorBg, int w, int h, int alignment) :
+		cOvgCmd(target), m_x(x), m_y(y), m_w(w), m_h(h),
+		m_symbols((unsigned int *)Data()), m_fontId(fontId),
+		m_fontSize(fontSize), m_colorFg(colorFg), m_colorBg(colorBg),
+		m_alignment(alignment)
 	{
-		free(m_symbols);
-		delete m_fontName;
+		Utf8ToArray(s, m_symbols, len + 1);
 	}
 
 	virtual const char* Description(void) { return "DrawText"; }
@@ -1192,11 +2390,12 @@ public:
 		if (!m_target->MakeCurrent(egl))
 			return false;
 
-		cOvgFont *font = cOvgFont::Get(*m_fontName);
+		// skip text of fonts which couldn't be registered
+		cOvgFont *font = cOvgFont::Get(m_fontId);
 		if (!font)
-			return false;
+			return true;
 
-		cOvgString *string = new cOvgString(m_symbols, font);
+		cOvgString *string = font->String(m_symbols);
 
 		VGfloat offsetX = 0;
 		VGfloat offsetY = 0;
@@ -1239,12 +2438,22 @@ public:
 			}
 		}
 
+		VGfloat x = m_x + offsetX;
+		VGfloat y = m_target->height - m_y - height + descender - offsetY + 1;
+
+		VGImage run = VG_INVALID_HANDLE;
+		VGfloat runX, runY;
+		bool cached = cOvgTextCache::Get(egl, m_fontId, m_symbols, string,
+				m_fontSize, m_colorFg, x, y, run, runX, runY);
+
+		if (!m_target->MakeCurrent(egl))
+			return false;
+
 		vgSeti(VG_BLEND_MODE, VG_BLEND_SRC);
 		vgSeti(VG_MATRIX_MODE, VG_MATRIX_GLYPH_USER_TO_SURFACE);
 
 		vgLoadIdentity();
-		vgTranslate(m_x + offsetX,
-				m_target->height - m_y - height + descender - offsetY + 1);
+		vgTranslate(x, y);
 		vgScale(m_fontSize, m_fontSize);
 
 		VGfloat origin[2] = { 0.0f, 0.0f };
@@ -1270,14 +2479,15 @@ public:
 		    vgClear(0, 0, m_target->width, m_target->height);
 		}
 
-		if (string->Length())
+		if (cached)
+			cOvgTextCache::Draw(run, runX, runY);
+		else if (string->Length())
 		{
 			cOvgPaintBox::SetColor(m_colorFg);
 			cOvgPaintBox::Draw(string);
 		}
 
 		cOvgPaintBox::SetScissoring();
-		delete string;
 		return true;
 	}
 
@@ -1288,7 +2498,7 @@ private:
 	int m_w;
 	int m_h;
 	unsigned int *m_symbols;
-	cString *m_fontName;
+	int m_fontId;
 	int m_fontSize;
 	tColor m_colorFg;
 	tColor m_colorBg;
@@ -1481,13 +2691,10 @@ class cOvgCmdStoreImage : public cOvgCmd
 {
 public:
 
-	cOvgCmdStoreImage(tOvgImageRef *image, int w, int h, tColor *argb) :
-		cOvgCmd(0), m_image(image), m_w(w), m_h(h), m_argb(argb) { }
-
-	virtual ~cOvgCmdStoreImage()
-	{
-		free(m_argb);
-	}
+	// the image is expected in the command's data
+	cOvgCmdStoreImage(tOvgImageRef *image, int w, int h) :
+		cOvgCmd(0), m_image(image), m_w(w), m_h(h),
+		m_argb((tColor *)Data()) { }
 
 	virtual const char* Description(void) { return "StoreImage"; }
 
@@ -1576,17 +2783,17 @@ class cOvgCmdDrawBitmap : public cOvgCmd
 {
 public:
 
+	// the bitmap is expected in the command's data, see Argb()
 	cOvgCmdDrawBitmap(cOvgRenderTarget *target,	int x, int y, int w, int h,
-			tColor *argb, bool overlay = false,	double scaleX = 1.0f,
-			double scaleY = 1.0f, bool antiAliased = true) :
-		cOvgCmd(target), m_x(x), m_y(y), m_w(w), m_h(h), m_argb(argb),
-		m_overlay(overlay), m_scaleX(scaleX), m_scaleY(scaleY),
-		m_antiAliased(antiAliased) { }
+			bool overlay = false, double scaleX = 1.0f, double scaleY = 1.0f,
+			bool antiAliased = true) :
+		cOvgCmd(target), m_x(x), m_y(y), m_w(w), m_h(h),
+		m_argb((tColor *)Data()), m_overlay(overlay), m_scaleX(scaleX),
+		m_scaleY(scaleY), m_antiAliased(antiAliased) { }
 
-	virtual ~cOvgCmdDrawBitmap()
-	{
-		free(m_argb);
-	}
+	static size_t DataSize(int w, int h) { return sizeof(tColor) * w * h; }
+
+	tColor *Argb(void) { return m_argb; }
 
 	virtual const char* Description(void) { return "DrawBitmap"; }
 
@@ -1612,48 +2819,266 @@ public:
 		vgTranslate(m_x, m_y - m_target->height);
 		vgScale(m_scaleX, m_scaleY);
 
-		VGImage image = vgCreateImage(VG_sARGB_8888, w, h,
-				VG_IMAGE_QUALITY_BETTER);
+		VGImage image = cOvgImagePool::Get(w, h);
+
+		if (image == VG_INVALID_HANDLE)
+		{
+			ELOG("failed to allocate image!");
+			return false;
+		}
+
+		vgImageSubData(image, m_argb, m_w * sizeof(tColor),
+				VG_sARGB_8888, 0, 0, w, h);
+
+		vgDrawImage(image);
+		return true;
+	}
+
+protected:
+
+	int m_x;
+	int m_y;
+	int m_w;
+	int m_h;
+	tColor *m_argb;
+	bool m_overlay;
+	double m_scaleX;
+	double m_scaleY;
+	bool m_antiAliased;
+};
+
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Statistics of the caches and the image pool, whose counters are owned by
+ * the render thread. A snapshot is taken and the counters are reset by the
+ * render thread itself when executing cOvgCmdGetStats.
+ */
+class cOvgRenderStats
+{
+public:
+
+	struct tStats
+	{
+		int hits, misses;              // string cache
+		int runHits, runs, runBytes;   // text cache
+		int allocs, reuses, allocTime; // image pool
+		int poolBytes;
+	};
+
+	cOvgRenderStats() : m_mutex(new cMutex()), m_seq(0)
+	{
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
+	~cOvgRenderStats()
+	{
+		delete m_mutex;
+	}
+
+	// to be called by the render thread only
+	void Take(void)
+	{
+		tStats stats;
+		cOvgStringCache::GetStats(stats.hits, stats.misses, true);
+		cOvgTextCache::GetStats(stats.runHits, stats.runs, stats.runBytes,
+				true);
+		cOvgImagePool::GetStats(stats.allocs, stats.reuses, stats.allocTime,
+				stats.poolBytes, true);
+
+		m_mutex->Lock();
+		m_stats = stats;
+		m_seq++;
+		m_mutex->Unlock();
+	}
+
+	// last snapshot, seq changes with each snapshot taken
+	tStats Get(int &seq)
+	{
+		m_mutex->Lock();
+		tStats stats = m_stats;
+		seq = m_seq;
+		m_mutex->Unlock();
+		return stats;
+	}
+
+private:
+
+	cMutex *m_mutex;
+	tStats  m_stats;
+	int     m_seq;
+
+	cOvgRenderStats(const cOvgRenderStats&);
+	cOvgRenderStats& operator= (const cOvgRenderStats&);
+};
+
+class cOvgCmdGetStats : public cOvgCmd
+{
+public:
+
+	cOvgCmdGetStats(cOvgRenderStats *stats) :
+		cOvgCmd(0), m_stats(stats) { }
+
+	virtual const char* Description(void) { return "GetStats"; }
+
+	virtual bool Execute(cEgl *egl)
+	{
+		m_stats->Take();
+		return true;
+	}
+
+private:
+
+	cOvgRenderStats *m_stats;
+};
+
+/* ------------------------------------------------------------------------- */
+
+#define OVG_MAX_OSDIMAGES 256
+
+#define OVG_CMDQUEUE_SIZE      2048
+#define OVG_CMDQUEUE_LOW_WATER (OVG_CMDQUEUE_SIZE / 2)
+
+/*
+ * Bounded command queue between any number of drawing threads and the render
+ * thread. Once the ring is full, producers are blocked until the render
+ * thread has drained it to the low water mark, so they don't get woken up for
+ * every single command executed. The render thread is woken up as soon as a
+ * command has been queued.
+ */
+class cOvgCmdQueue
+{
+public:
+
+	struct Stats
+	{
+		int depth;
+		int maxDepth;
+		int stalls;
+		int stallTime;    // ms
+		int maxStallTime;
+	};
+
+	cOvgCmdQueue() :
+		m_head(0), m_tail(0), m_count(0), m_stalled(false), m_waiting(false),
+		m_stallStart(0), m_mutex(new cMutex()), m_notEmpty(new cCondVar()),
+		m_notFull(new cCondVar())
+	{
+		memset(&m_stats, 0, sizeof(m_stats));
+	}
+
+	~cOvgCmdQueue()
+	{
+		delete m_notFull;
+		delete m_notEmpty;
+		delete m_mutex;
+	}
+
+	void Push(cOvgCmd *cmd)
+	{
+		m_mutex->Lock();
+		while (m_stalled)
+			m_notFull->Wait(*m_mutex);
+
+		m_ring[m_tail] = cmd;
+		m_tail = (m_tail + 1) % OVG_CMDQUEUE_SIZE;
+		m_count++;
+
+		if (m_count > m_stats.maxDepth)
+			m_stats.maxDepth = m_count;
+
+		if (m_count == OVG_CMDQUEUE_SIZE)
+		{
+			ILOG("[OpenVG] command queue stalled!");
+			m_stalled = true;
+			m_stallStart = cTimeMs::Now();
+			m_stats.stalls++;
+		}
+
+		if (m_waiting)
+			m_notEmpty->Broadcast();
+
+		m_mutex->Unlock();
+	}
+
+	// returns 0 if no command has been queued within timeout
+	cOvgCmd *Pop(int timeoutMs)
+	{
+		cOvgCmd *cmd = 0;
+		m_mutex->Lock();
+
+		if (!m_count && timeoutMs > 0)
+		{
+			m_waiting = true;
+			m_notEmpty->TimedWait(*m_mutex, timeoutMs);
+			m_waiting = false;
+		}
+
+		if (m_count)
+		{
+			cmd = m_ring[m_head];
+			m_head = (m_head + 1) % OVG_CMDQUEUE_SIZE;
+			m_count--;
+
+			if (m_stalled && m_count <= OVG_CMDQUEUE_LOW_WATER)
+			{
+				int stallTime = cTimeMs::Now() - m_stallStart;
+				m_stats.stallTime += stallTime;
+				if (stallTime > m_stats.maxStallTime)
+					m_stats.maxStallTime = stallTime;
+
+				DLOG("[OpenVG] command queue stalled for %dms", stallTime);
+				m_stalled = false;
+				m_notFull->Broadcast();
+			}
+		}
+
+		m_mutex->Unlock();
+		return cmd;
+	}
 
-		if (image == VG_INVALID_HANDLE)
+	// statistics since last reset
+	Stats GetStats(bool reset = false)
+	{
+		m_mutex->Lock();
+		Stats stats = m_stats;
+		stats.depth = m_count;
+		if (reset)
 		{
-			ELOG("failed to allocate image!");
-			return false;
+			memset(&m_stats, 0, sizeof(m_stats));
+			m_stats.maxDepth = m_count;
 		}
+		m_mutex->Unlock();
+		return stats;
+	}
 
-		vgImageSubData(image, m_argb, m_w * sizeof(tColor),
-				VG_sARGB_8888, 0, 0, w, h);
+private:
 
-		vgDrawImage(image);
+	cOvgCmd  *m_ring[OVG_CMDQUEUE_SIZE];
+	int       m_head;
+	int       m_tail;
+	int       m_count;
+	bool      m_stalled;
+	bool      m_waiting;
+	uint64_t  m_stallStart;
 
-		vgDestroyImage(image);
-		return true;
-	}
+	cMutex   *m_mutex;
+	cCondVar *m_notEmpty;
+	cCondVar *m_notFull;
 
-protected:
+	Stats     m_stats;
 
-	int m_x;
-	int m_y;
-	int m_w;
-	int m_h;
-	tColor *m_argb;
-	bool m_overlay;
-	double m_scaleX;
-	double m_scaleY;
-	bool m_antiAliased;
+	cOvgCmdQueue(const cOvgCmdQueue&);
+	cOvgCmdQueue& operator= (const cOvgCmdQueue&);
 };
 
-/* ------------------------------------------------------------------------- */
-
-#define OVG_MAX_OSDIMAGES 256
-#define OVG_CMDQUEUE_SIZE 2048
-
 class cOvgThread : public cThread
 {
 public:
 
 	cOvgThread(int layer) :	cThread("ovgthread"),
-		m_wait(new cCondWait()), m_stalled(false), m_layer(layer)
+		m_commands(new cOvgCmdQueue()), m_arena(0), m_freeArenas(0),
+		m_layer(layer), m_resets(0), m_preserved(false)
 	{
 		for (int i = 0; i < OVG_MAX_OSDIMAGES; i++)
 			m_images[i].used = false;
@@ -1664,33 +3089,84 @@ public:
 	virtual ~cOvgThread()
 	{
 		Cancel(-1);
-		DoCmd(new cOvgCmdReset(), true);
+		DoCmd(new (this) cOvgCmdReset());
 
 		while (Active())
 			cCondWait::SleepMs(50);
 
-		delete m_wait;
+		// destroy commands left in the queue before dropping their arenas
+		while (cOvgCmd *cmd = m_commands->Pop(0))
+			ReleaseCmd(cmd);
+
+		for (unsigned int i = 0; i < m_arenas.size(); i++)
+			delete m_arenas[i];
+
+		delete m_commands;
 	}
 
-	void DoCmd(cOvgCmd* cmd, bool signal = false)
+	void DoCmd(cOvgCmd* cmd)
 	{
-		while (m_stalled)
-			cCondWait::SleepMs(10);
+		if (!cmd)
+		{
+			ELOG("[OpenVG] failed to allocate command!");
+			return;
+		}
 
-		Lock();
-		m_commands.push(cmd);
-		Unlock();
+		// start a new arena with each flush, so the current one can be
+		// recycled once the flush has been executed
+		if (cmd->IsFlush())
+		{
+			Lock();
+			if (cmd->Arena() == m_arena)
+			{
+				m_arena->m_sealed = true;
+				m_arena = 0;
+			}
+			Unlock();
+		}
+
+		m_commands->Push(cmd);
+	}
+
+	cOvgCmdQueue::Stats GetQueueStats(bool reset)
+	{
+		return m_commands->GetStats(reset);
+	}
+
+	// statistics of the render thread since the last call, false if the
+	// render thread didn't take its snapshot in time
+	bool GetRenderStats(cOvgRenderStats::tStats &stats)
+	{
+		int seq, current;
+		m_renderStats.Get(seq);
+		DoCmd(new (this) cOvgCmdGetStats(&m_renderStats));
 
-		if (m_commands.size() > OVG_CMDQUEUE_SIZE)
+		cTimeMs timer(1000);
+		do
 		{
-			m_stalled = true;
-			ILOG("[OpenVG] command queue stalled!");
+			stats = m_renderStats.Get(current);
+			if (current != seq)
+				return true;
+			cCondWait::SleepMs(2);
 		}
+		while (!timer.TimedOut());
+		return false;
+	}
 
-		if (signal || m_stalled)
-			m_wait->Signal();
+	// recreate the window surface, which loses its content
+	void Reset(bool cleanup)
+	{
+		DoCmd(new (this) cOvgCmdReset(cleanup));
+		__sync_fetch_and_add(&m_resets, 1);
 	}
 
+	// changes whenever the window surface has been or will be recreated,
+	// either on request or after a failed command
+	int Resets(void) const { return m_resets; }
+
+	// whether the window surface keeps its content between flushes
+	bool Preserved(void) const { return m_preserved; }
+
 	virtual int StoreImageData(const cImage &image)
 	{
 		if (image.Width() > m_maxImageSize.Width() ||
@@ -1707,20 +3183,21 @@ public:
 		int imageHandle = GetFreeImageHandle();
 		if (imageHandle)
 		{
-			tColor *argb = MALLOC(tColor, image.Width() * image.Height());
-			if (!argb)
+			tOvgImageRef *imageRef = GetImageRef(imageHandle);
+			cOvgCmdStoreImage *cmd = new (this, sizeof(tColor) *
+					image.Width() * image.Height())
+					cOvgCmdStoreImage(imageRef, image.Width(), image.Height());
+			if (!cmd)
 			{
 				FreeImageHandle(imageHandle);
 				imageHandle = 0;
 			}
 			else
 			{
-				memcpy(argb, image.Data(),
+				memcpy(cmd->Data(), image.Data(),
 						sizeof(tColor) * image.Width() * image.Height());
 
-				tOvgImageRef *imageRef = GetImageRef(imageHandle);
-				DoCmd(new cOvgCmdStoreImage(imageRef,
-						image.Width(), image.Height(), argb), true);
+				DoCmd(cmd);
 
 				cTimeMs timer(5000);
 				while (imageRef->used && imageRef->image == VG_INVALID_HANDLE
@@ -1741,7 +3218,7 @@ public:
 
 	virtual void DropImageData(int imageHandle)
 	{
-		DoCmd(new cOvgCmdDropImage(GetImageRef(imageHandle)));
+		DoCmd(new (this) cOvgCmdDropImage(GetImageRef(imageHandle)));
 	}
 
 	virtual const cSize &MaxImageSize(void) const
@@ -1758,6 +3235,31 @@ public:
 		return 0;
 	}
 
+	// allocate memory for a command in the current arena
+	void *AllocCmd(size_t size, cOvgCmdArena *&arena)
+	{
+		Lock();
+		if (!m_arena)
+		{
+			if (m_freeArenas)
+			{
+				m_arena = m_freeArenas;
+				m_freeArenas = m_arena->m_next;
+			}
+			else
+			{
+				m_arena = new cOvgCmdArena();
+				m_arenas.push_back(m_arena);
+			}
+		}
+		arena = m_arena;
+		void *p = m_arena->Alloc(size);
+		if (p)
+			m_arena->m_pending++;
+		Unlock();
+		return p;
+	}
+
 protected:
 
 	virtual int GetFreeImageHandle(void)
@@ -1782,6 +3284,24 @@ protected:
 			m_images[i].used = false;
 	}
 
+	// destroy an executed command and recycle its arena once it's done
+	void ReleaseCmd(cOvgCmd *cmd)
+	{
+		cOvgCmdArena *arena = cmd->Arena();
+		void *allocation = cmd->Allocation();
+		cmd->~cOvgCmd();
+
+		Lock();
+		arena->Free(allocation);
+		if (!--arena->m_pending && arena->m_sealed)
+		{
+			arena->Recycle();
+			arena->m_next = m_freeArenas;
+			m_freeArenas = arena;
+		}
+		Unlock();
+	}
+
 	virtual void Action(void)
 	{
 		DLOG("cOvgThread() thread started");
@@ -1797,20 +3317,27 @@ protected:
 
 		eglBindAPI(EGL_OPENVG_API);
 
-		const EGLint attr[] = {
+		EGLint attr[] = {
 			EGL_RED_SIZE, 8,
 			EGL_GREEN_SIZE, 8,
 			EGL_BLUE_SIZE, 8,
 			EGL_ALPHA_SIZE, 8,
-			EGL_SURFACE_TYPE, EGL_WINDOW_BIT | EGL_PBUFFER_BIT,
+			EGL_SURFACE_TYPE, EGL_WINDOW_BIT | EGL_PBUFFER_BIT |
+					EGL_SWAP_BEHAVIOR_PRESERVED_BIT,
 			EGL_CONFORMANT, EGL_OPENVG_BIT,
 			EGL_NONE
 		};
 
-		// get an appropriate EGL frame buffer configuration
+		// get an appropriate EGL frame buffer configuration, preferably one
+		// which allows to preserve the window content between flushes
 		if (eglChooseConfig(egl.display, attr, &egl.config, 1, &egl.nConfig)
-				== EGL_FALSE)
-			ELOG("[EGL] failed to get frame buffer config!");
+				== EGL_FALSE || egl.nConfig < 1)
+		{
+			attr[9] = EGL_WINDOW_BIT | EGL_PBUFFER_BIT;
+			if (eglChooseConfig(egl.display, attr, &egl.config, 1,
+					&egl.nConfig) == EGL_FALSE)
+				ELOG("[EGL] failed to get frame buffer config!");
+		}
 
 		// create an EGL rendering context
 		egl.context = eglCreateContext(egl.display, egl.config, NULL, NULL);
@@ -1847,9 +3374,11 @@ protected:
 				ELOG("[EGL] failed to create window surface: %s!",
 						cEgl::errStr(eglGetError()));
 
-			if (eglSurfaceAttrib(egl.display, egl.surface,
-					EGL_SWAP_BEHAVIOR, EGL_BUFFER_PRESERVED) == EGL_FALSE)
-				ELOG("[EGL] failed to set surface attributes: %s!",
+			// without, each flush needs to compose the entire OSD
+			m_preserved = eglSurfaceAttrib(egl.display, egl.surface,
+					EGL_SWAP_BEHAVIOR, EGL_BUFFER_PRESERVED) != EGL_FALSE;
+			if (!m_preserved)
+				ELOG("[EGL] failed to preserve window surface content: %s!",
 						cEgl::errStr(eglGetError()));
 
 			if (eglMakeCurrent(egl.display, egl.surface, egl.surface,
@@ -1865,6 +3394,7 @@ protected:
 			float color[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 			vgSetfv(VG_CLEAR_COLOR, 4, color);
 			vgClear(0, 0, egl.window.width, egl.window.height);
+			__sync_fetch_and_add(&m_resets, 1);
 
 #ifdef DEBUG_OVGSTAT
 			cTimeMs timer;
@@ -1874,22 +3404,33 @@ protected:
 			bool reset = false;
 			while (!reset)
 			{
-				if (m_commands.empty())
-					m_wait->Wait(20);
-				else
+				if (cOvgCmd* cmd = m_commands->Pop(100))
 				{
-					Lock();
-					cOvgCmd* cmd = m_commands.front();
-					m_commands.pop();
-					Unlock();
-
 #ifdef DEBUG_OVGSTAT
 					if (timer.TimedOut())
 					{
 						if (commands || flushes)
 						{
-							DLOG("[OpenVG] commands executed: %d, flushes: %d",
-									commands, flushes);
+							// counters are reset by OSDSTAT only
+							cOvgCmdQueue::Stats stats =
+									m_commands->GetStats(false);
+							int hits, misses, runHits, runs, runBytes;
+							cOvgStringCache::GetStats(hits, misses, false);
+							cOvgTextCache::GetStats(runHits, runs, runBytes,
+									false);
+							int allocs, reuses, allocTime, poolBytes;
+							cOvgImagePool::GetStats(allocs, reuses, allocTime,
+									poolBytes, false);
+							DLOG("[OpenVG] commands executed: %d, flushes: %d, "
+									"queue depth: %d (max %d), stalls: %d "
+									"(%dms), string cache hits: %d/%d, "
+									"text cache hits: %d, rendered: %d (%dkB), "
+									"image allocations: %d (%dus), reuses: %d",
+									commands, flushes, stats.depth,
+									stats.maxDepth, stats.stalls,
+									stats.stallTime, hits, hits + misses,
+									runHits, runs, runBytes / 1024,
+									allocs, allocTime, reuses);
 							commands = 0;
 							flushes = 0;
 						}
@@ -1899,19 +3440,18 @@ protected:
 					if (cmd->IsFlush())
 						flushes++;
 #endif
-					reset = cmd ? !cmd->Execute(&egl) : true;
+					reset = !cmd->Execute(&egl);
 
 					VGErrorCode err = vgGetError();
-					if (cmd && err != VG_NO_ERROR)
+					if (err != VG_NO_ERROR)
 						ELOG("[OpenVG] %s error: %s",
 								cmd->Description(), errStr(err));
 
 					//ELOG("[OpenVG] %s", cmd->Description());
-					delete cmd;
-
-					if (m_stalled && m_commands.size() < OVG_CMDQUEUE_SIZE / 2)
-						m_stalled = false;
+					ReleaseCmd(cmd);
 				}
+				else
+					cOvgImagePool::Trim();
 			}
 
 			if (eglMakeCurrent(egl.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
@@ -1935,6 +3475,8 @@ protected:
 			if (m_images[i].used)
 				vgDestroyImage(m_images[i].image);
 
+		cOvgImagePool::Trim(true);
+		cOvgTextCache::CleanUp(&egl);
 		cOvgFont::CleanUp();
 		cOvgPaintBox::CleanUp();
 		vgFinish();
@@ -1962,18 +3504,49 @@ private:
 						"unknown error";
 	}
 
-	std::queue<cOvgCmd*> m_commands;
-	cCondWait *m_wait;
-	bool m_stalled;
+	cOvgCmdQueue *m_commands;
+
+	cOvgCmdArena *m_arena;
+	cOvgCmdArena *m_freeArenas;
+	std::vector<cOvgCmdArena*> m_arenas;
+
+	cOvgRenderStats m_renderStats;
+
 	int m_layer;
+	volatile int m_resets;
+	volatile bool m_preserved;
 
 	tOvgImageRef m_images[OVG_MAX_OSDIMAGES];
 
 	cSize m_maxImageSize;
 };
 
+void *cOvgCmd::operator new(size_t size, cOvgThread *ovg, size_t data) throw()
+{
+	cOvgCmdArena *arena;
+	size = OVG_ARENA_ALIGN(size);
+
+	unsigned char *p = (unsigned char *)ovg->AllocCmd(
+			HeaderSize() + size + data, arena);
+	if (!p)
+		return 0;
+
+	Header *header = (Header *)p;
+	header->arena = arena;
+	header->size = size;
+	return p + HeaderSize();
+}
+
 /* ------------------------------------------------------------------------- */
 
+#define OVG_PIXMAP_PENDING 32 // rectangles held back per pixmap
+
+/*
+ * Filled rectangles and clears replace all pixels of their area, so a pixmap
+ * holds them back until any other command is issued for its buffer and drops
+ * those which are overwritten by a later one, joins adjacent ones of the same
+ * color and skips those which wouldn't change a uniformly filled buffer.
+ */
 class cOvgPixmap : public cPixmap
 {
 public:
@@ -1984,13 +3557,21 @@ public:
 		m_ovg(ovg),
 		m_buffer(buffer),
 		m_savedRegion(new cOvgSavedRegion()),
-		m_dirty(false)
+		m_dirty(false),
+		m_composed(false),
+		m_composedLayer(0),
+		m_numPending(0),
+		m_uniform(false),
+		m_uniformColor(clrTransparent)
 	{ }
 
 	virtual ~cOvgPixmap()
 	{
-		m_ovg->DoCmd(new cOvgCmdDropRegion(m_savedRegion));
-		m_ovg->DoCmd(new cOvgCmdDestroySurface(m_buffer));
+		// drawing which will never be shown
+		DropPending();
+
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdDropRegion(m_savedRegion));
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdDestroySurface(m_buffer));
 	}
 
 	virtual void SetAlpha(int Alpha)
@@ -2000,6 +3581,7 @@ public:
 		{
 			cPixmap::SetAlpha(Alpha);
 			SetDirty();
+			MarkViewPortDirty(ViewPort());
 		}
 	}
 
@@ -2007,49 +3589,55 @@ public:
 	{
 		cPixmap::SetTile(Tile);
 		SetDirty();
+		MarkViewPortDirty(ViewPort());
 	}
 
 	virtual void SetViewPort(const cRect &Rect)
 	{
 		cPixmap::SetViewPort(Rect);
 		SetDirty();
+		MarkViewPortDirty(ViewPort());
 	}
 
 	virtual void SetDrawPortPoint(const cPoint &Point, bool Dirty = true)
 	{
 		cPixmap::SetDrawPortPoint(Point, Dirty);
 		if (Dirty)
+		{
 			SetDirty();
+			MarkViewPortDirty(ViewPort());
+		}
 	}
 
 	virtual void Clear(void)
 	{
 		LOCK_PIXMAPS;
-		m_ovg->DoCmd(new cOvgCmdClear(m_buffer));
+		AddRect(cRect::Null, clrTransparent, true);
 		SetDirty();
-		MarkDrawPortDirty(DrawPort());
+		MarkDrawPortDirty(DrawPort().Size());
 	}
 
 	virtual void Fill(tColor Color)
 	{
 		LOCK_PIXMAPS;
-		m_ovg->DoCmd(new cOvgCmdClear(m_buffer, Color));
+		AddRect(cRect::Null, Color, true);
 		SetDirty();
-		MarkDrawPortDirty(DrawPort());
+		MarkDrawPortDirty(DrawPort().Size());
 	}
 
 	virtual void DrawImage(const cPoint &Point, const cImage &Image)
 	{
 		LOCK_PIXMAPS;
-		tColor *argb = MALLOC(tColor, Image.Width() * Image.Height());
-		if (!argb)
+		cOvgCmdDrawBitmap *cmd = new (m_ovg, cOvgCmdDrawBitmap::DataSize(
+				Image.Width(), Image.Height())) cOvgCmdDrawBitmap(m_buffer,
+				Point.X(), Point.Y(), Image.Width(), Image.Height(), false);
+		if (!cmd)
 			return;
 
-		memcpy(argb, Image.Data(),
+		memcpy(cmd->Argb(), Image.Data(),
 				sizeof(tColor) * Image.Width() * Image.Height());
 
-		m_ovg->DoCmd(new cOvgCmdDrawBitmap(m_buffer, Point.X(), Point.Y(),
-				Image.Width(), Image.Height(), argb, false));
+		DoCmd(cmd);
 
 		SetDirty();
 		MarkDrawPortDirty(cRect(Point, cSize(Image.Width(),
@@ -2059,9 +3647,14 @@ public:
 	virtual void DrawImage(const cPoint &Point, int ImageHandle)
 	{
 		if (ImageHandle < 0 && m_ovg->GetImageRef(ImageHandle))
-			m_ovg->DoCmd(new cOvgCmdDrawImage(m_buffer,
+		{
+			DoCmd(new (m_ovg) cOvgCmdDrawImage(m_buffer,
 					&m_ovg->GetImageRef(ImageHandle)->image,
 					Point.X(), Point.Y()));
+
+			// size of stored images is only known to the render thread
+			MarkDrawPortDirty(cRect(Point, DrawPort().Size()));
+		}
 		else
 			if (cRpiOsdProvider::GetImageData(ImageHandle))
 				DrawImage(Point, *cRpiOsdProvider::GetImageData(ImageHandle));
@@ -2072,7 +3665,7 @@ public:
 	virtual void DrawPixel(const cPoint &Point, tColor Color)
 	{
 		LOCK_PIXMAPS;
-		m_ovg->DoCmd(new cOvgCmdDrawPixel(m_buffer, Point.X(), Point.Y(),
+		DoCmd(new (m_ovg) cOvgCmdDrawPixel(m_buffer, Point.X(), Point.Y(),
 				Color, Layer() == 0 && !IS_OPAQUE(Color)));
 
 		SetDirty();
@@ -2084,11 +3677,13 @@ public:
 	{
 		LOCK_PIXMAPS;
 		bool specialColors = ColorFg || ColorBg;
-		tColor *argb = MALLOC(tColor, Bitmap.Width() * Bitmap.Height());
-		if (!argb)
+		cOvgCmdDrawBitmap *cmd = new (m_ovg, cOvgCmdDrawBitmap::DataSize(
+				Bitmap.Width(), Bitmap.Height())) cOvgCmdDrawBitmap(m_buffer,
+				Point.X(), Point.Y(), Bitmap.Width(), Bitmap.Height(), Overlay);
+		if (!cmd)
 			return;
 
-		tColor *p = argb;
+		tColor *p = cmd->Argb();
 		for (int py = 0; py < Bitmap.Height(); py++)
 			for (int px = 0; px < Bitmap.Width(); px++)
 			{
@@ -2098,8 +3693,7 @@ public:
 								Bitmap.Color(index)) : Bitmap.Color(index));
 			}
 
-		m_ovg->DoCmd(new cOvgCmdDrawBitmap(m_buffer, Point.X(), Point.Y(),
-				Bitmap.Width(), Bitmap.Height(), argb, Overlay));
+		DoCmd(cmd);
 
 		SetDirty();
 		MarkDrawPortDirty(cRect(Point, cSize(Bitmap.Width(),
@@ -2110,18 +3704,19 @@ public:
 			double FactorX, double FactorY, bool AntiAlias = false)
 	{
 		LOCK_PIXMAPS;
-		tColor *argb = MALLOC(tColor, Bitmap.Width() * Bitmap.Height());
-		if (!argb)
+		cOvgCmdDrawBitmap *cmd = new (m_ovg, cOvgCmdDrawBitmap::DataSize(
+				Bitmap.Width(), Bitmap.Height())) cOvgCmdDrawBitmap(m_buffer,
+				Point.X(), Point.Y(), Bitmap.Width(), Bitmap.Height(), false,
+				FactorX, FactorY, AntiAlias);
+		if (!cmd)
 			return;
 
-		tColor *p = argb;
+		tColor *p = cmd->Argb();
 		for (int py = 0; py < Bitmap.Height(); py++)
 			for (int px = 0; px < Bitmap.Width(); px++)
 				*p++ = Bitmap.Color(*Bitmap.Data(px, py));
 
-		m_ovg->DoCmd(new cOvgCmdDrawBitmap(m_buffer, Point.X(), Point.Y(),
-				Bitmap.Width(), Bitmap.Height(), argb, false,
-				FactorX, FactorY, AntiAlias));
+		DoCmd(cmd);
 
 		SetDirty();
 		MarkDrawPortDirty(cRect(Point, cSize(
@@ -2136,22 +3731,15 @@ public:
 	{
 		LOCK_PIXMAPS;
 		int len = s ? Utf8StrLen(s) : 0;
-		unsigned int *symbols = MALLOC(unsigned int, len + 1);
-		if (!symbols)
-			return;
-
 		if (len)
-		{
-			Utf8ToArray(s, symbols, len + 1);
-			m_ovg->DoCmd(new cOvgCmdDrawText(m_buffer, Point.X(), Point.Y(),
-				symbols, new cString(Font->FontName()), Font->Size(),
+			DoCmd(new (m_ovg, cOvgCmdDrawText::DataSize(len))
+				cOvgCmdDrawText(m_buffer, Point.X(), Point.Y(), s, len,
+				cOvgFont::Id(Font->FontName()), Font->Size(),
 				ColorFg, ColorBg, Width, Height, Alignment));
-		}
 		else
 		{
 			if (Width && Height)
-				m_ovg->DoCmd(new cOvgCmdDrawRectangle(m_buffer,
-					Point.X(), Point.Y(), Width, Height, ColorBg));
+				AddRect(cRect(Point.X(), Point.Y(), Width, Height), ColorBg);
 		}
 
 		SetDirty();
@@ -2163,8 +3751,7 @@ public:
 	virtual void DrawRectangle(const cRect &Rect, tColor Color)
 	{
 		LOCK_PIXMAPS;
-		m_ovg->DoCmd(new cOvgCmdDrawRectangle(m_buffer,
-				Rect.X(), Rect.Y(),	Rect.Width(), Rect.Height(), Color));
+		AddRect(Rect, Color);
 
 		SetDirty();
 		MarkDrawPortDirty(Rect);
@@ -2173,7 +3760,7 @@ public:
 	virtual void DrawEllipse(const cRect &Rect, tColor Color, int Quadrants = 0)
 	{
 		LOCK_PIXMAPS;
-		m_ovg->DoCmd(new cOvgCmdDrawEllipse(m_buffer,
+		DoCmd(new (m_ovg) cOvgCmdDrawEllipse(m_buffer,
 				Rect.X(), Rect.Y(),	Rect.Width(), Rect.Height(),
 				Color, Quadrants));
 
@@ -2184,7 +3771,7 @@ public:
 	virtual void DrawSlope(const cRect &Rect, tColor Color, int Type)
 	{
 		LOCK_PIXMAPS;
-		m_ovg->DoCmd(new cOvgCmdDrawSlope(m_buffer,
+		DoCmd(new (m_ovg) cOvgCmdDrawSlope(m_buffer,
 				Rect.X(), Rect.Y(),	Rect.Width(), Rect.Height(), Color, Type));
 
 		SetDirty();
@@ -2200,12 +3787,13 @@ public:
 
 		if (const cOvgPixmap *pm = dynamic_cast<const cOvgPixmap *>(Pixmap))
 		{
-			m_ovg->DoCmd(new cOvgCmdRenderPixels(m_buffer, pm->m_buffer,
+			const_cast<cOvgPixmap *>(pm)->SubmitPending();
+			DoCmd(new (m_ovg) cOvgCmdRenderPixels(m_buffer, pm->m_buffer,
 					Dest.X(), Dest.Y(), Source.X(), Source.Y(),
 					Source.Width(), Source.Height(), pm->Alpha()));
 
 			SetDirty();
-			MarkDrawPortDirty(DrawPort());
+			MarkDrawPortDirty(cRect(Dest, Source.Size()));
 		}
 	}
 
@@ -2215,12 +3803,13 @@ public:
 		LOCK_PIXMAPS;
 		if (const cOvgPixmap *pm = dynamic_cast<const cOvgPixmap *>(Pixmap))
 		{
-			m_ovg->DoCmd(new cOvgCmdCopyPixels(m_buffer, pm->m_buffer,
+			const_cast<cOvgPixmap *>(pm)->SubmitPending();
+			DoCmd(new (m_ovg) cOvgCmdCopyPixels(m_buffer, pm->m_buffer,
 					Dest.X(), Dest.Y(), Source.X(), Source.Y(),
 					Source.Width(), Source.Height()));
 
 			SetDirty();
-			MarkDrawPortDirty(DrawPort());
+			MarkDrawPortDirty(cRect(Dest, Source.Size()));
 		}
 	}
 
@@ -2235,14 +3824,17 @@ public:
 
 		if (Dest != s.Point())
 		{
-			m_ovg->DoCmd(new cOvgCmdMovePixels(m_buffer, Dest.X(), Dest.Y(),
+			DoCmd(new (m_ovg) cOvgCmdMovePixels(m_buffer, Dest.X(), Dest.Y(),
 					s.X(), s.Y(), s.Width(), s.Height()));
 
 			if (pan)
+			{
 				SetDrawPortPoint(DrawPort().Point().Shifted(s.Point() -	Dest),
 						false);
+				MarkViewPortDirty(ViewPort());
+			}
 			else
-				MarkDrawPortDirty(Dest);
+				MarkDrawPortDirty(cRect(Dest, s.Size()));
 			SetDirty();
 		}
 	}
@@ -2259,14 +3851,15 @@ public:
 
 	virtual void SaveRegion(const cRect &Source)
 	{
-		m_ovg->DoCmd(new cOvgCmdSaveRegion(m_buffer, m_savedRegion,
+		DoCmd(new (m_ovg) cOvgCmdSaveRegion(m_buffer, m_savedRegion,
 				Source.X(), Source.Y(), Source.Width(), Source.Height()));
 	}
 
 	virtual void RestoreRegion(void)
 	{
-		m_ovg->DoCmd(new cOvgCmdRestoreRegion(m_buffer, m_savedRegion));
+		DoCmd(new (m_ovg) cOvgCmdRestoreRegion(m_buffer, m_savedRegion));
 		SetDirty();
+		MarkDrawPortDirty(DrawPort().Size());
 	}
 
 	virtual void CopyToTarget(cOvgRenderTarget *target, int left, int top)
@@ -2275,43 +3868,335 @@ public:
 		cRect d = ViewPort().Shifted(left, top);
 		cPoint s = -DrawPort().Point();
 
-		m_ovg->DoCmd(new cOvgCmdCopyPixels(target, m_buffer,
+		SubmitPending();
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdCopyPixels(target, m_buffer,
 				d.X(), d.Y(), s.X(), s.Y(), d.Width(), d.Height()));
 
 		SetDirty(false);
 	}
 
-	virtual void RenderToTarget(cOvgRenderTarget *target, int left, int top)
+	// render the part of the view port within clip, which is given in target
+	// coordinates, returns the number of pixels rendered
+	virtual int RenderToTarget(cOvgRenderTarget *target, int left, int top,
+			const cRect &clip = cRect::Null)
 	{
 		LOCK_PIXMAPS;
-		cRect d = ViewPort().Shifted(left, top);
-		cPoint s = -DrawPort().Point();
+		cRect v = ViewPort().Shifted(left, top);
+		cRect d = clip.IsEmpty() ? v : v.Intersected(clip);
+		if (d.IsEmpty())
+			return 0;
 
+		// source moves along with the clipped destination
+		cPoint s = d.Point() - v.Point() - DrawPort().Point();
+
+		SubmitPending();
 		if (Tile())
-			m_ovg->DoCmd(new cOvgCmdRenderPattern(target, m_buffer,
+			m_ovg->DoCmd(new (m_ovg) cOvgCmdRenderPattern(target, m_buffer,
 					d.X(), d.Y(), s.X(), s.Y(), d.Width(), d.Height(),
 					Alpha()));
 		else
-			m_ovg->DoCmd(new cOvgCmdRenderPixels(target, m_buffer,
+			m_ovg->DoCmd(new (m_ovg) cOvgCmdRenderPixels(target, m_buffer,
 					d.X(), d.Y(), s.X(), s.Y(), d.Width(), d.Height(),
 					Alpha()));
 
+		return d.Width() * d.Height();
+	}
+
+	// area of the OSD which needs to be composed again since the last call,
+	// covering changes of the content as well as of layer and view port
+	cRect Damage(void)
+	{
+		LOCK_PIXMAPS;
+		cRect damage;
+		bool visible = Layer() >= 0;
+		bool moved = Layer() != m_composedLayer ||
+				ViewPort() != m_composedViewPort;
+
+		if (m_composed && (!visible || moved))
+			damage.Combine(m_composedViewPort);
+
+		if (visible)
+		{
+			if (!m_composed || moved)
+				damage.Combine(ViewPort());
+			else if (m_dirty)
+				// not all drawing operations can tell what they changed
+				damage.Combine(DirtyViewPort().IsEmpty() ? ViewPort() :
+						DirtyViewPort().Intersected(ViewPort()));
+		}
+
+		m_composed = visible;
+		m_composedLayer = Layer();
+		m_composedViewPort = ViewPort();
+
+		SetClean();
 		SetDirty(false);
+		return damage;
 	}
 
 	virtual bool IsDirty(void) { return m_dirty; }
 	virtual void SetDirty(bool dirty = true) { m_dirty = dirty; }
 
+	// issue the rectangles held back
+	void SubmitPending(void)
+	{
+		LOCK_PIXMAPS;
+		for (int i = 0; i < m_numPending; i++)
+		{
+			tPendingRect *p = &m_pending[i];
+			if (p->full)
+				m_ovg->DoCmd(new (m_ovg) cOvgCmdClear(m_buffer, p->color));
+			else
+				m_ovg->DoCmd(new (m_ovg) cOvgCmdDrawRectangle(m_buffer,
+						p->rect.X(), p->rect.Y(),
+						p->rect.Width(), p->rect.Height(), p->color));
+		}
+		m_numPending = 0;
+	}
+
+	static void GetStats(int &rects, int &eliminated, uint64_t &pixels,
+			bool reset)
+	{
+		rects = s_rects;
+		eliminated = s_eliminated;
+		pixels = s_savedPixels;
+		if (reset)
+		{
+			s_rects = s_eliminated = 0;
+			s_savedPixels = 0;
+		}
+	}
+
 private:
 
 	cOvgPixmap(const cOvgPixmap&);
 	cOvgPixmap& operator= (const cOvgPixmap&);
 
+	struct tPendingRect
+	{
+		cRect  rect;
+		tColor color;
+		bool   full; // entire buffer
+	};
+
+	// all commands other than filled rectangles go through here
+	void DoCmd(cOvgCmd *cmd)
+	{
+		SubmitPending();
+		m_uniform = false;
+		m_ovg->DoCmd(cmd);
+	}
+
+	static int Size(const cRect &rect)
+	{
+		return rect.IsEmpty() ? 0 : rect.Width() * rect.Height();
+	}
+
+	// number of pixels of rect within the buffer, entire buffer if full
+	int Area(const cRect &rect, bool full = false) const
+	{
+		cRect buffer(0, 0, m_buffer->width, m_buffer->height);
+		return Size(full ? buffer : buffer.Intersected(rect));
+	}
+
+	void Eliminate(int pixels)
+	{
+		s_eliminated++;
+		s_savedPixels += pixels;
+	}
+
+	void AddRect(const cRect &rect, tColor color, bool full = false)
+	{
+		// leave odd rectangles to the render thread as they are
+		if (!full && rect.IsEmpty())
+		{
+			DoCmd(new (m_ovg) cOvgCmdDrawRectangle(m_buffer,
+					rect.X(), rect.Y(), rect.Width(), rect.Height(), color));
+			return;
+		}
+		s_rects++;
+
+		if (m_uniform && color == m_uniformColor)
+		{
+			Eliminate(Area(rect, full));
+			return;
+		}
+
+		if (full)
+		{
+			DropPending();
+			m_uniform = true;
+			m_uniformColor = color;
+		}
+		else
+		{
+			m_uniform = false;
+
+			// drop what the new rectangle overwrites anyway
+			int n = 0;
+			for (int i = 0; i < m_numPending; i++)
+				if (!m_pending[i].full && rect.Contains(m_pending[i].rect))
+					Eliminate(Area(m_pending[i].rect));
+				else
+					m_pending[n++] = m_pending[i];
+			m_numPending = n;
+
+			// join with a rectangle of the same color to a single one, as long
+			// as nothing drawn in between overlaps
+			for (int i = m_numPending - 1; i >= 0; i--)
+			{
+				tPendingRect *p = &m_pending[i];
+				if (p->color == color)
+				{
+					if (p->full)
+					{
+						Eliminate(Area(rect));
+						return;
+					}
+					cRect joined = p->rect;
+					joined.Combine(rect);
+					cRect overlap = p->rect.Intersected(rect);
+					if (Size(joined) + Size(overlap) ==
+							Size(p->rect) + Size(rect))
+					{
+						p->rect = joined;
+						Eliminate(Area(overlap));
+						return;
+					}
+				}
+				if (p->full || p->rect.Intersects(rect))
+					break;
+			}
+		}
+
+		if (m_numPending == OVG_PIXMAP_PENDING)
+			SubmitPending();
+
+		tPendingRect *p = &m_pending[m_numPending++];
+		p->rect = rect;
+		p->color = color;
+		p->full = full;
+	}
+
+	void DropPending(void)
+	{
+		for (int i = 0; i < m_numPending; i++)
+			Eliminate(Area(m_pending[i].rect, m_pending[i].full));
+		m_numPending = 0;
+	}
+
 	cOvgThread       *m_ovg;
 	cOvgRenderTarget *m_buffer;
 	cOvgSavedRegion  *m_savedRegion;
 
 	bool m_dirty;
+
+	// state of last composition
+	bool  m_composed;
+	int   m_composedLayer;
+	cRect m_composedViewPort;
+
+	tPendingRect m_pending[OVG_PIXMAP_PENDING];
+	int          m_numPending;
+
+	// buffer entirely filled with m_uniformColor once pending rects are drawn
+	bool   m_uniform;
+	tColor m_uniformColor;
+
+	static int      s_rects;
+	static int      s_eliminated;
+	static uint64_t s_savedPixels;
+};
+
+int      cOvgPixmap::s_rects = 0;
+int      cOvgPixmap::s_eliminated = 0;
+uint64_t cOvgPixmap::s_savedPixels = 0;
+
+/* ------------------------------------------------------------------------- */
+
+#define OVG_DAMAGE_RECTS 4
+
+/*
+ * Damaged area of the OSD, kept as a few rectangles, so changes far apart
+ * don't need everything in between to be composed again. Overlapping
+ * rectangles are joined, and if there are too many, the two which add the
+ * least area when joined.
+ */
+class cOvgDamage
+{
+public:
+
+	cOvgDamage() : m_num(0) { }
+
+	void Clear(void) { m_num = 0; }
+	bool IsEmpty(void) const { return !m_num; }
+	int Count(void) const { return m_num; }
+	const cRect& Rect(int i) const { return m_rects[i]; }
+
+	void Add(const cRect &rect)
+	{
+		if (rect.IsEmpty())
+			return;
+
+		m_rects[m_num++] = rect;
+		while (JoinOverlapping() || m_num > OVG_DAMAGE_RECTS)
+			if (m_num > OVG_DAMAGE_RECTS)
+				JoinCheapest();
+	}
+
+	void Add(const cOvgDamage &damage)
+	{
+		for (int i = 0; i < damage.m_num; i++)
+			Add(damage.m_rects[i]);
+	}
+
+private:
+
+	static int Area(const cRect &rect)
+	{
+		return rect.Width() * rect.Height();
+	}
+
+	void Join(int i, int j)
+	{
+		m_rects[i].Combine(m_rects[j]);
+		m_rects[j] = m_rects[--m_num];
+	}
+
+	bool JoinOverlapping(void)
+	{
+		for (int i = 0; i < m_num; i++)
+			for (int j = i + 1; j < m_num; j++)
+				if (m_rects[i].Intersects(m_rects[j]))
+				{
+					Join(i, j);
+					return true;
+				}
+		return false;
+	}
+
+	void JoinCheapest(void)
+	{
+		int best = -1, bestI = 0, bestJ = 1;
+		for (int i = 0; i < m_num; i++)
+			for (int j = i + 1; j < m_num; j++)
+			{
+				cRect joined = m_rects[i];
+				joined.Combine(m_rects[j]);
+				int cost = Area(joined) -
+						Area(m_rects[i]) - Area(m_rects[j]);
+				if (best < 0 || cost < best)
+				{
+					best = cost;
+					bestI = i;
+					bestJ = j;
+				}
+			}
+		Join(bestI, bestJ);
+	}
+
+	cRect m_rects[OVG_DAMAGE_RECTS + 1];
+	int   m_num;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -2323,7 +4208,8 @@ public:
 	cOvgOsd(int Left, int Top, uint Level, cOvgThread *ovg) :
 		cOsd(Left, Top, Level),
 		m_ovg(ovg),
-		m_surface(new cOvgRenderTarget())
+		m_surface(new cOvgRenderTarget()),
+		m_resets(-1)
 	{
 		cTimeMs timer(10000);
 		while (!m_ovg->MaxImageSize().Height() && !timer.TimedOut())
@@ -2333,7 +4219,7 @@ public:
 	virtual ~cOvgOsd()
 	{
 		SetActive(false);
-		m_ovg->DoCmd(new cOvgCmdDestroySurface(m_surface));
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdDestroySurface(m_surface));
 	}
 
 	virtual eOsdError SetAreas(const tArea *Areas, int NumAreas)
@@ -2389,7 +4275,7 @@ public:
 #endif
 		// create pixel buffer and wait until command has been completed
 		cOvgRenderTarget *buffer = new cOvgRenderTarget(width, height);
-		m_ovg->DoCmd(new cOvgCmdCreatePixelBuffer(buffer), true);
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdCreatePixelBuffer(buffer));
 
 		cTimeMs timer(10000);
 		while (!buffer->initialized && !timer.TimedOut())
@@ -2415,7 +4301,7 @@ public:
 		{
 			ELOG("[OpenVG] failed to create pixmap! (%s)",
 					timer.TimedOut() ? "timed out" : "allocation failed");
-			m_ovg->DoCmd(new cOvgCmdDestroySurface(buffer));
+			m_ovg->DoCmd(new (m_ovg) cOvgCmdDestroySurface(buffer));
 		}
 		return NULL;
 	}
@@ -2428,8 +4314,8 @@ public:
 			for (int i = 1; i < m_pixmaps.Size(); i++)
 				if (m_pixmaps[i] == Pixmap)
 				{
-					if (Pixmap->Layer() >= 0)
-						m_pixmaps[0]->SetDirty();
+					// the area it has been composed to, even if hidden since
+					m_damage.Add(m_pixmaps[i]->Damage());
 
 					m_pixmaps[i] = NULL;
 					cOsd::DestroyPixmap(Pixmap);
@@ -2549,6 +4435,14 @@ public:
 				s, ColorFg, ColorBg, Font, Width, Height, Alignment);
 	}
 
+	static void GetStats(uint64_t &composed, uint64_t &full, bool reset)
+	{
+		composed = s_composedPixels;
+		full = s_fullPixels;
+		if (reset)
+			s_composedPixels = s_fullPixels = 0;
+	}
+
 	virtual void Flush(void)
 	{
 		if (!Active())
@@ -2569,24 +4463,51 @@ public:
 #endif
 		}
 #else
-		bool dirty = false;
-		for (int i = 0; i < m_pixmaps.Size() && !dirty; i++)
-			if (m_pixmaps[i] &&
-					m_pixmaps[i]->Layer() >= 0 && m_pixmaps[i]->IsDirty())
-				dirty = true;
+		// the window surface keeps its content between flushes, so only the
+		// damaged area needs to be composed again, unless it's been recreated
+		// or can't be preserved
+		int resets = m_ovg->Resets();
+		bool full = resets != m_resets || !m_ovg->Preserved();
+		m_resets = resets;
+
+		cOvgDamage damage = m_damage;
+		m_damage.Clear();
+		for (int i = 0; i < m_pixmaps.Size(); i++)
+			if (m_pixmaps[i])
+				damage.Add(m_pixmaps[i]->Damage());
 
-		if (!dirty)
+		if (!full && damage.IsEmpty())
 			return;
 
-		m_ovg->DoCmd(new cOvgCmdClear(m_surface));
-
+		int pixels = 0;
+		int fullPixels = Width() * Height();
 		for (int layer = 0; layer < MAXPIXMAPLAYERS; layer++)
 			for (int i = 0; i < m_pixmaps.Size(); i++)
-				if (m_pixmaps[i])
-					if (m_pixmaps[i]->Layer() == layer)
-						m_pixmaps[i]->RenderToTarget(m_surface, Left(), Top());
+				if (m_pixmaps[i] && m_pixmaps[i]->Layer() == layer)
+					fullPixels += m_pixmaps[i]->ViewPort().Width() *
+							m_pixmaps[i]->ViewPort().Height();
+
+		for (int r = 0; r < (full ? 1 : damage.Count()); r++)
+		{
+			cRect clip = full ? cRect::Null :
+					damage.Rect(r).Shifted(Left(), Top());
+			pixels += full ? Width() * Height() :
+					clip.Width() * clip.Height();
+
+			m_ovg->DoCmd(new (m_ovg) cOvgCmdClear(m_surface, clrTransparent,
+					clip));
+
+			for (int layer = 0; layer < MAXPIXMAPLAYERS; layer++)
+				for (int i = 0; i < m_pixmaps.Size(); i++)
+					if (m_pixmaps[i] && m_pixmaps[i]->Layer() == layer)
+						pixels += m_pixmaps[i]->RenderToTarget(m_surface,
+								Left(), Top(), clip);
+		}
+
+		s_composedPixels += pixels;
+		s_fullPixels += fullPixels;
 #endif
-		m_ovg->DoCmd(new cOvgCmdFlush(m_surface), true);
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdFlush(m_surface));
 		return;
 	}
 
@@ -2598,7 +4519,10 @@ protected:
 		{
 			cOsd::SetActive(On);
 			if (!On)
+			{
 				Clear();
+				m_resets = -1;
+			}
 			else
 				if (GetBitmap(0))
 					Flush();
@@ -2607,8 +4531,8 @@ protected:
 
 	virtual void Clear(void)
 	{
-		m_ovg->DoCmd(new cOvgCmdClear(m_surface));
-		m_ovg->DoCmd(new cOvgCmdFlush(m_surface));
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdClear(m_surface));
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdFlush(m_surface));
 	}
 
 private:
@@ -2616,8 +4540,18 @@ private:
 	cOvgThread           *m_ovg;
 	cOvgRenderTarget     *m_surface;
 	cVector<cOvgPixmap *> m_pixmaps;
+
+	int   m_resets;  // of render thread at last flush, -1 to redraw all
+	cOvgDamage m_damage; // left by destroyed pixmaps
+
+	// statistics, composed pixels vs. pixels of a full redraw
+	static uint64_t s_composedPixels;
+	static uint64_t s_fullPixels;
 };
 
+uint64_t cOvgOsd::s_composedPixels = 0;
+uint64_t cOvgOsd::s_fullPixels = 0;
+
 /* ------------------------------------------------------------------------- */
 
 class cOvgRawOsd : public cOsd
@@ -2633,7 +4567,7 @@ public:
 	virtual ~cOvgRawOsd()
 	{
 		SetActive(false);
-		m_ovg->DoCmd(new cOvgCmdDestroySurface(m_surface));
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdDestroySurface(m_surface));
 	}
 
 	virtual void Flush(void)
@@ -2647,17 +4581,19 @@ public:
 			while (cPixmapMemory *pm =
 					dynamic_cast<cPixmapMemory *>(RenderPixmaps()))
 			{
-				if (tColor* argb = MALLOC(tColor,
-						pm->DrawPort().Width() * pm->DrawPort().Height()))
+				if (cOvgCmdDrawBitmap *cmd = new (m_ovg,
+						cOvgCmdDrawBitmap::DataSize(pm->DrawPort().Width(),
+								pm->DrawPort().Height()))
+						cOvgCmdDrawBitmap(m_surface,
+								Left() + pm->ViewPort().Left(),
+								Top() + pm->ViewPort().Top(),
+								pm->DrawPort().Width(),
+								pm->DrawPort().Height()))
 				{
-					memcpy(argb, pm->Data(), sizeof(tColor) *
+					memcpy(cmd->Argb(), pm->Data(), sizeof(tColor) *
 							pm->DrawPort().Width() * pm->DrawPort().Height());
 
-					m_ovg->DoCmd(new cOvgCmdDrawBitmap(m_surface,
-							Left() + pm->ViewPort().Left(),
-							Top() + pm->ViewPort().Top(),
-							pm->DrawPort().Width(), pm->DrawPort().Height(),
-							argb));
+					m_ovg->DoCmd(cmd);
 				}
 #if APIVERSNUM >= 20110
 				DestroyPixmap(pm);
@@ -2675,24 +4611,26 @@ public:
 				{
 					int w = x2 - x1 + 1;
 					int h = y2 - y1 + 1;
-					tColor *argb = MALLOC(tColor, w * h);
-					if (!argb)
+					cOvgCmdDrawBitmap *cmd = new (m_ovg,
+							cOvgCmdDrawBitmap::DataSize(w, h))
+							cOvgCmdDrawBitmap(m_surface,
+									Left() + bitmap->X0() + x1,
+									Top() + bitmap->Y0() + y1, w, h);
+					if (!cmd)
 						return;
 
-					tColor *p = argb;
+					tColor *p = cmd->Argb();
 					for (int y = y1; y <= y2; ++y)
 						for (int x = x1; x <= x2; ++x)
 							*p++ = bitmap->GetColor(x, y);
 
-					m_ovg->DoCmd(new cOvgCmdDrawBitmap(m_surface,
-							Left() + bitmap->X0() + x1,
-							Top() + bitmap->Y0() + y1, w, h, argb));
+					m_ovg->DoCmd(cmd);
 
 					bitmap->Clean();
 				}
 			}
 		}
-		m_ovg->DoCmd(new cOvgCmdFlush(m_surface), true);
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdFlush(m_surface));
 	}
 
 	virtual eOsdError SetAreas(const tArea *Areas, int NumAreas)
@@ -2728,8 +4666,8 @@ protected:
 
 	virtual void Clear(void)
 	{
-		m_ovg->DoCmd(new cOvgCmdClear(m_surface));
-		m_ovg->DoCmd(new cOvgCmdFlush(m_surface));
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdClear(m_surface));
+		m_ovg->DoCmd(new (m_ovg) cOvgCmdFlush(m_surface));
 	}
 
 private:
@@ -2750,6 +4688,15 @@ cRpiOsdProvider::cRpiOsdProvider(int layer) :
 	DLOG("new cOsdProvider()");
 	m_ovg = new cOvgThread(layer);
 	s_instance = this;
+
+	// get the skin's fonts ready before the first OSD opens
+	for (int i = 0; i < eDvbFontSize; i++)
+		if (const cFont *font = cFont::GetFont((eDvbFont)i))
+		{
+			int id = cOvgFont::Id(font->FontName());
+			if (id >= 0)
+				m_ovg->DoCmd(new (m_ovg) cOvgCmdPreloadFont(id));
+		}
 }
 
 cRpiOsdProvider::~cRpiOsdProvider()
@@ -2786,10 +4733,50 @@ const cImage *cRpiOsdProvider::GetImageData(int ImageHandle)
 	return cOsdProvider::GetImageData(ImageHandle);
 }
 
+cString cRpiOsdProvider::Status(void)
+{
+	if (!s_instance)
+		return "OSD not active";
+
+	cOvgRenderStats::tStats r;
+	if (!s_instance->m_ovg->GetRenderStats(r))
+		return "OSD render thread not responding";
+
+	cOvgCmdQueue::Stats stats = s_instance->m_ovg->GetQueueStats(true);
+
+	// only written while drawing and flushing the OSD with pixmaps locked
+	uint64_t composed, full, savedPixels;
+	int rects, eliminated;
+	{
+		LOCK_PIXMAPS;
+		cOvgOsd::GetStats(composed, full, true);
+		cOvgPixmap::GetStats(rects, eliminated, savedPixels, true);
+	}
+
+	return cString::sprintf("command queue depth: %d (max %d of %d), "
+			"stalls: %d, stall time: %dms (max %dms), "
+			"string cache hits: %d of %d (%d%%), "
+			"text cache hits: %d, rendered: %d, size: %dkB of %dkB, "
+			"composed pixels: %d%% of full redraw, "
+			"rectangles eliminated: %d of %d (%llukpx), "
+			"image allocations: %d (%dus), reuses: %d (~%lldus saved), "
+			"pool size: %dkB",
+			stats.depth, stats.maxDepth, OVG_CMDQUEUE_SIZE, stats.stalls,
+			stats.stallTime, stats.maxStallTime, r.hits, r.hits + r.misses,
+			r.hits + r.misses ? 100 * r.hits / (r.hits + r.misses) : 0,
+			r.runHits, r.runs, r.runBytes / 1024, cRpiSetup::TextCacheSize(),
+			full ? (int)(100 * composed / full) : 0,
+			eliminated, rects, savedPixels / 1000,
+			r.allocs, r.allocTime, r.reuses,
+			// reuses save the average allocation time each
+			r.allocs ? (long long)r.allocTime * r.reuses / r.allocs : 0LL,
+			r.poolBytes / 1024);
+}
+
 void cRpiOsdProvider::ResetOsd(bool cleanup)
 {
 	if (s_instance)
-		s_instance->m_ovg->DoCmd(new cOvgCmdReset(cleanup));
+		s_instance->m_ovg->Reset(cleanup);
 
 	UpdateOsdSize(true);
 }
@@ -35,6 +35,9 @@ public:
 	static void ResetOsd(bool cleanup = false);
 	static const cImage *GetImageData(int ImageHandle);
 
+	// command queue and text cache statistics since last call
+	static cString Status(void);
+
 protected:
 
 	virtual cOsd *CreateOsd(int Left, int Top, uint Level);
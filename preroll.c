@@ -0,0 +1,147 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "preroll.h"
+#include "tools.h"
+
+#include <vdr/tools.h>
+
+// packets arriving right after zapping come in a burst from VDR's receive
+// buffer and don't tell anything about the source's jitter
+#define PREROLL_SETTLE_TIME 2000
+
+// a spread beyond this is considered as discontinuity, not as jitter
+#define PREROLL_MAX_SPREAD  3000
+
+#define PREROLL_MARGIN      50
+
+cRpiPreRoll::cRpiPreRoll() :
+	m_channel(0),
+	m_startTime(0),
+	m_windowStart(0),
+	m_minOffset(0),
+	m_maxOffset(0),
+	m_samples(0)
+{
+	for (int i = 0; i < PREROLL_HISTORY; i++)
+	{
+		m_history[i].number = 0;
+		m_history[i].jitter = -1;
+		m_history[i].lastUsed = 0;
+	}
+}
+
+cRpiPreRoll::Channel* cRpiPreRoll::Find(int number, bool create)
+{
+	Channel *oldest = &m_history[0];
+	for (int i = 0; i < PREROLL_HISTORY; i++)
+	{
+		if (m_history[i].number == number)
+			return &m_history[i];
+
+		if (m_history[i].lastUsed < oldest->lastUsed)
+			oldest = &m_history[i];
+	}
+	if (!create)
+		return 0;
+
+	oldest->number = number;
+	oldest->jitter = -1;
+	return oldest;
+}
+
+void cRpiPreRoll::Start(int channel)
+{
+	m_channel = channel ? Find(channel, true) : 0;
+	if (m_channel)
+		m_channel->lastUsed = cTimeMs::Now();
+
+	m_startTime = cTimeMs::Now();
+	m_windowStart = 0;
+	m_samples = 0;
+}
+
+void cRpiPreRoll::Arrival(int64_t pts)
+{
+	if (!m_channel)
+		return;
+
+	uint64_t now = cTimeMs::Now();
+	if (now - m_startTime < PREROLL_SETTLE_TIME)
+		return;
+
+	int64_t offset = (int64_t)now - pts / 90;
+
+	if (!m_samples)
+	{
+		m_windowStart = now;
+		m_minOffset = offset;
+		m_maxOffset = offset;
+	}
+	else if (offset < m_minOffset)
+		m_minOffset = offset;
+	else if (offset > m_maxOffset)
+		m_maxOffset = offset;
+
+	m_samples++;
+
+	if (now - m_windowStart < PREROLL_WINDOW)
+		return;
+
+	int spread = m_maxOffset - m_minOffset;
+	m_samples = 0;
+
+	if (spread > PREROLL_MAX_SPREAD)
+	{
+		DBG("ignoring PTS discontinuity in jitter measurement");
+		return;
+	}
+
+	// follow higher jitter immediately, decay slowly
+	int jitter = m_channel->jitter;
+	m_channel->jitter = jitter < 0 || spread > jitter ? spread :
+			(jitter * 7 + spread) / 8;
+
+	if (m_channel->jitter != jitter)
+		DBG("channel %d: jitter=%dms, pre-roll=%dms",
+				m_channel->number, m_channel->jitter, Get());
+}
+
+void cRpiPreRoll::Stall(void)
+{
+	if (!m_channel)
+		return;
+
+	// the current estimate was obviously too optimistic
+	m_channel->jitter = m_channel->jitter < PREROLL_DEFAULT / 2 ?
+			PREROLL_DEFAULT : m_channel->jitter * 2;
+
+	DBG("channel %d: buffer stall, pre-roll=%dms", m_channel->number, Get());
+}
+
+int cRpiPreRoll::Get(void)
+{
+	if (!m_channel || m_channel->jitter < 0)
+		return PREROLL_DEFAULT;
+
+	int preRoll = m_channel->jitter + m_channel->jitter / 4 + PREROLL_MARGIN;
+
+	return preRoll < PREROLL_MIN ? PREROLL_MIN :
+			preRoll > PREROLL_MAX ? PREROLL_MAX : preRoll;
+}
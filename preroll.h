@@ -0,0 +1,83 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef PRE_ROLL_H
+#define PRE_ROLL_H
+
+#include <stdint.h>
+
+/*
+ * Estimates the pre-roll needed in live mode from the arrival jitter of PES
+ * packets. The jitter is measured as the spread of arrival time against PTS
+ * within windows of PREROLL_WINDOW ms and kept per channel, so the estimate
+ * survives zapping. Rising jitter and buffer stalls are taken into account
+ * immediately, while lower jitter only slowly reduces the pre-roll.
+ */
+
+#define PREROLL_DEFAULT 250  // ms, used for unknown channels
+#define PREROLL_MIN     80
+#define PREROLL_MAX     1000
+#define PREROLL_WINDOW  5000
+#define PREROLL_HISTORY 64   // number of channels
+
+class cRpiPreRoll
+{
+
+public:
+
+	cRpiPreRoll();
+	virtual ~cRpiPreRoll() { }
+
+	// start measuring on given channel, 0 to stop
+	void Start(int channel);
+
+	// packet with given (unwrapped) PTS has arrived
+	void Arrival(int64_t pts);
+
+	// buffer stall happened on current channel
+	void Stall(void);
+
+	// pre-roll in ms for current channel
+	int Get(void);
+
+private:
+
+	struct Channel
+	{
+		int      number;
+		int      jitter;   // ms, -1 if not measured yet
+		uint64_t lastUsed;
+	};
+
+	Channel* Find(int number, bool create);
+
+	Channel  m_history[PREROLL_HISTORY];
+	Channel *m_channel;
+
+	uint64_t m_startTime;
+	uint64_t m_windowStart;
+	int64_t  m_minOffset;
+	int64_t  m_maxOffset;
+	int      m_samples;
+
+	cRpiPreRoll(const cRpiPreRoll&);
+	cRpiPreRoll& operator= (const cRpiPreRoll&);
+};
+
+#endif
@@ -24,8 +24,13 @@
 #include "omxdevice.h"
 #include "setup.h"
 #include "display.h"
+#include "zapstat.h"
+#include "buffertrace.h"
+#include "grabber.h"
 #include "tools.h"
 
+#include <ctype.h>
+
 static const char *VERSION        = "1.0.5";
 static const char *DESCRIPTION    = trNOOP("HD output device for Raspberry Pi");
 
@@ -52,10 +57,15 @@ public:
 	virtual bool Start(void);
 	virtual void Stop(void);
 	virtual void Housekeeping(void) {}
+	virtual void MainThreadHook(void);
 	virtual const char *MainMenuEntry(void) { return NULL; }
 	virtual cOsdObject *MainMenuAction(void) { return NULL; }
 	virtual cMenuSetupPage *SetupMenu(void);
 	virtual bool SetupParse(const char *Name, const char *Value);
+	virtual bool Service(const char *Id, void *Data = NULL);
+	virtual const char **SVDRPHelpPages(void);
+	virtual cString SVDRPCommand(const char *Command, const char *Option,
+			int &ReplyCode);
 };
 
 cPluginRpiHdDevice::cPluginRpiHdDevice(void) :
@@ -65,8 +75,12 @@ cPluginRpiHdDevice::cPluginRpiHdDevice(void) :
 
 cPluginRpiHdDevice::~cPluginRpiHdDevice()
 {
-	cRpiSetup::DropInstance();
+	// the display needs the hardware, which is released with the setup
+	cRpiFrameGrabber::Stop();
 	cRpiDisplay::DropInstance();
+	cRpiSetup::DropInstance();
+	cRpiZapStat::DropInstance();
+	cRpiBufferTrace::Stop();
 }
 
 bool cPluginRpiHdDevice::Initialize(void)
@@ -78,6 +92,8 @@ bool cPluginRpiHdDevice::Initialize(void)
 	if (!cRpiSetup::IsVideoCodecSupported(cVideoCodec::eMPEG2))
 		DLOG("MPEG2 video decoder not enabled!");
 
+	cRpiZapStat::GetInstance();
+
 	m_device = new cOmxDevice(&OnPrimaryDevice,
 			cRpiDisplay::GetId(), cRpiSetup::VideoLayer());
 
@@ -94,6 +110,14 @@ bool cPluginRpiHdDevice::Start(void)
 
 void cPluginRpiHdDevice::Stop(void)
 {
+	cRpiFrameGrabber::Stop();
+}
+
+void cPluginRpiHdDevice::MainThreadHook(void)
+{
+	cRpiDisplay::CheckSnapshotTimeout();
+	if (m_device)
+		m_device->CheckGrabTimeout();
 }
 
 cMenuSetupPage* cPluginRpiHdDevice::SetupMenu(void)
@@ -106,6 +130,19 @@ bool cPluginRpiHdDevice::SetupParse(const char *Name, const char *Value)
 	return cRpiSetup::GetInstance()->Parse(Name, Value);
 }
 
+bool cPluginRpiHdDevice::Service(const char *Id, void *Data)
+{
+	if (strcmp(Id, "RpiHdDevice-GetPreview-v1.0") == 0)
+	{
+		if (!Data)
+			return true;
+
+		return cRpiFrameGrabber::GetFrame(
+				static_cast<RpiHdDevice_GetPreview_v1_0*>(Data));
+	}
+	return false;
+}
+
 bool cPluginRpiHdDevice::ProcessArgs(int argc, char *argv[])
 {
 	return cRpiSetup::GetInstance()->ProcessArgs(argc, argv);
@@ -116,4 +153,134 @@ const char *cPluginRpiHdDevice::CommandLineHelp(void)
 	return cRpiSetup::GetInstance()->CommandLineHelp();
 }
 
+const char **cPluginRpiHdDevice::SVDRPHelpPages(void)
+{
+	static const char *HelpPages[] = {
+		"TRACE [ ON | OFF | DUMP <file> ]\n"
+		"    Start or stop recording of OMX buffer events, or write the\n"
+		"    recorded events to <file>. Without option, the current\n"
+		"    recording state is returned.",
+		"PREVIEW [ ON [ <fps> [ <width>x<height> ] ] | OFF ]\n"
+		"    Start or stop grabbing preview frames in the background,\n"
+		"    by default with 2 fps at 320x180. Without option, the current\n"
+		"    state and the cost per frame is returned.",
+		"OSDSTAT\n"
+		"    Return the OSD command queue depth, the time drawing threads\n"
+		"    have been blocked, the hit rate of the text layout cache, the\n"
+		"    share of pixels composed compared to a full redraw, the\n"
+		"    number of redundant rectangles dropped and the allocations\n"
+		"    saved by the image pool since the last query.",
+		"ZAPSTAT\n"
+		"    Return minimum, average and maximum zap time and a histogram\n"
+		"    of the last 32 zaps, and the average zap time of video codec\n"
+		"    changes with and without the standby decoder.",
+		NULL
+	};
+	return HelpPages;
+}
+
+cString cPluginRpiHdDevice::SVDRPCommand(const char *Command,
+		const char *Option, int &ReplyCode)
+{
+	if (strcasecmp(Command, "TRACE") == 0)
+	{
+		if (!*Option)
+			return cString::sprintf("buffer trace is %s",
+					cRpiBufferTrace::IsActive() ? "on" : "off");
+
+		if (strcasecmp(Option, "ON") == 0)
+		{
+			if (cRpiBufferTrace::Start())
+				return "buffer trace started";
+
+			ReplyCode = 554;
+			return "failed to start buffer trace";
+		}
+		if (strcasecmp(Option, "OFF") == 0)
+		{
+			cRpiBufferTrace::Stop();
+			return "buffer trace stopped";
+		}
+		if (strncasecmp(Option, "DUMP", 4) == 0)
+		{
+			const char *fileName = skipspace(Option + 4);
+			if (!*fileName)
+			{
+				ReplyCode = 501;
+				return "missing file name";
+			}
+			int records = cRpiBufferTrace::Dump(fileName);
+			if (records < 0)
+			{
+				ReplyCode = 554;
+				return cString::sprintf("failed to write %s", fileName);
+			}
+			return cString::sprintf("%d events written to %s",
+					records, fileName);
+		}
+		ReplyCode = 501;
+		return cString::sprintf("unknown option \"%s\"", Option);
+	}
+	if (strcasecmp(Command, "OSDSTAT") == 0)
+		return cRpiOsdProvider::Status();
+
+	if (strcasecmp(Command, "ZAPSTAT") == 0)
+		return cRpiZapStat::Status();
+
+	if (strcasecmp(Command, "PREVIEW") == 0)
+	{
+		if (!*Option)
+			return cRpiFrameGrabber::Status();
+
+		if (strncasecmp(Option, "ON", 2) == 0 &&
+				(!Option[2] || isspace(Option[2])))
+		{
+			int fps = GRABBER_DEF_FPS;
+			int width = GRABBER_DEF_WIDTH;
+			int height = GRABBER_DEF_HEIGHT;
+
+			// frame rate first, then the optional size
+			const char *args = skipspace(Option + 2);
+			char *end = (char *)args;
+			bool valid = true;
+			if (*args)
+			{
+				fps = strtol(args, &end, 10);
+				valid = end != args && (!*end || isspace(*end));
+			}
+			const char *size = skipspace(end);
+			if (valid && *size)
+			{
+				int n = 0;
+				valid = sscanf(size, "%dx%d%n", &width, &height, &n) == 2 &&
+						!*skipspace(size + n);
+			}
+			if (!valid)
+			{
+				ReplyCode = 501;
+				return cString::sprintf("invalid arguments \"%s\"", args);
+			}
+			if (fps < GRABBER_MIN_FPS || fps > GRABBER_MAX_FPS)
+			{
+				ReplyCode = 501;
+				return cString::sprintf("frame rate must be %d to %d fps",
+						GRABBER_MIN_FPS, GRABBER_MAX_FPS);
+			}
+			if (cRpiFrameGrabber::Start(fps, width, height))
+				return cRpiFrameGrabber::Status();
+
+			ReplyCode = 554;
+			return "failed to start preview";
+		}
+		if (strcasecmp(Option, "OFF") == 0)
+		{
+			cRpiFrameGrabber::Stop();
+			return "preview stopped";
+		}
+		ReplyCode = 501;
+		return cString::sprintf("unknown option \"%s\"", Option);
+	}
+	return NULL;
+}
+
 VDRPLUGINCREATOR(cPluginRpiHdDevice); // Don't touch this! okay.
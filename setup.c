@@ -362,11 +362,17 @@ void cRpiSetup::Set(AudioParameters audio, VideoParameters video,
 bool cRpiSetup::ProcessArgs(int argc, char *argv[])
 {
 	const int cDisplayOpt = 0x100;
+	const int cReverseCacheOpt = 0x101;
+	const int cLiveLatencyOpt = 0x102;
+	const int cTextCacheOpt = 0x103;
 	static struct option long_options[] = {
-			{ "disable-osd", no_argument,       NULL, 'd'         },
-			{ "display",     required_argument, NULL, cDisplayOpt },
-			{ "video-layer", required_argument, NULL, 'v'         },
-			{ "osd-layer",   required_argument, NULL, 'o'         },
+			{ "disable-osd",   no_argument,       NULL, 'd'              },
+			{ "display",       required_argument, NULL, cDisplayOpt      },
+			{ "video-layer",   required_argument, NULL, 'v'              },
+			{ "osd-layer",     required_argument, NULL, 'o'              },
+			{ "reverse-cache", required_argument, NULL, cReverseCacheOpt },
+			{ "live-latency",  required_argument, NULL, cLiveLatencyOpt  },
+			{ "text-cache",    required_argument, NULL, cTextCacheOpt    },
 			{ 0, 0, 0, 0 }
 	};
 	int c;
@@ -400,6 +406,33 @@ bool cRpiSetup::ProcessArgs(int argc, char *argv[])
 			}
 		}
 			break;
+		case cReverseCacheOpt:
+		{
+			int size = atoi(optarg);
+			if (size > 0)
+				m_plugin.reverseCacheSize = size;
+			else
+				ELOG("invalid reverse cache size (%d), using default!", size);
+		}
+			break;
+		case cLiveLatencyOpt:
+		{
+			int latency = atoi(optarg);
+			if (latency >= 0)
+				m_plugin.liveLatency = latency;
+			else
+				ELOG("invalid live latency (%d), using default!", latency);
+		}
+			break;
+		case cTextCacheOpt:
+		{
+			int size = atoi(optarg);
+			if (size >= 0)
+				m_plugin.textCacheSize = size;
+			else
+				ELOG("invalid text cache size (%d), using default!", size);
+		}
+			break;
 		default:
 			return false;
 		}
@@ -407,6 +440,10 @@ bool cRpiSetup::ProcessArgs(int argc, char *argv[])
 	DBG("dispmanx layers: video=%d, osd=%d (%s), display=%d",
 			m_plugin.videoLayer, m_plugin.osdLayer,
 			m_plugin.hasOsd ? "enabled" : "disabled", m_plugin.display);
+	DBG("reverse playback cache: %dMB, live latency: %s",
+			m_plugin.reverseCacheSize, m_plugin.liveLatency ?
+			*cString::sprintf("%dms", m_plugin.liveLatency) : "auto");
+	DBG("OSD text cache: %dkB", m_plugin.textCacheSize);
 
 	return true;
 }
@@ -420,5 +457,14 @@ const char *cRpiSetup::CommandLineHelp(void)
 			"                           0: default display (default)\n"
 			"                           4: LCD\n"
 			"                           5: TV/HDMI\n"
-			"                           6: non-default display\n";
+			"                           6: non-default display\n"
+			"            --reverse-cache\n"
+			"                           memory in MB used for reverse playback\n"
+			"                           (default 8)\n"
+			"            --live-latency\n"
+			"                           buffer latency in ms targeted in live\n"
+			"                           mode (default 0: follow pre-roll)\n"
+			"            --text-cache   GPU memory in kB used to cache rendered\n"
+			"                           text, incl. 512kB scratch buffer\n"
+			"                           (default 2048, <= 512: disabled)\n";
 }
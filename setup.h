@@ -82,12 +82,16 @@ public:
 	struct PluginParameters
 	{
 		PluginParameters() :
-			hasOsd(true), display(0), videoLayer(0), osdLayer(2) { }
+			hasOsd(true), display(0), videoLayer(0), osdLayer(2),
+			reverseCacheSize(8), liveLatency(0), textCacheSize(2048) { }
 
 		bool hasOsd;
 		int display;
 		int videoLayer;
 		int osdLayer;
+		int reverseCacheSize;
+		int liveLatency;
+		int textCacheSize;
 	};
 
 	static bool HwInit(void);
@@ -165,6 +169,18 @@ public:
 		return GetInstance()->m_plugin.osdLayer;
 	}
 
+	static int ReverseCacheSize(void) {
+		return GetInstance()->m_plugin.reverseCacheSize;
+	}
+
+	static int LiveLatency(void) {
+		return GetInstance()->m_plugin.liveLatency;
+	}
+
+	static int TextCacheSize(void) {
+		return GetInstance()->m_plugin.textCacheSize;
+	}
+
 	static void SetHDMIChannelMapping(bool passthrough, int channels);
 
 	static cRpiSetup* GetInstance(void);
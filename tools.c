@@ -18,6 +18,7 @@
  */
 
 #include <limits.h>
+#include <time.h>
 #include <vdr/tools.h>
 #include "tools.h"
 #include <algorithm>
@@ -109,3 +110,20 @@ int cRational::Gcd(int u, int v)
 
     return Gcd((v - u) >> 1, u);
 }
+
+static uint64_t ClockUs(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t cTimeUs::Now(void)
+{
+	return ClockUs(CLOCK_MONOTONIC);
+}
+
+uint64_t cTimeUs::ThreadCpu(void)
+{
+	return ClockUs(CLOCK_THREAD_CPUTIME_ID);
+}
@@ -20,6 +20,8 @@
 #ifndef TOOLS_H
 #define TOOLS_H
 
+#include <stdint.h>
+
 #define ELOG(a...) esyslog("rpihddevice: " a)
 #define ILOG(a...) isyslog("rpihddevice: " a)
 #define DLOG(a...) dsyslog("rpihddevice: " a)
@@ -237,4 +239,15 @@ private:
 	static int Gcd(int u, int v);
 };
 
+class cTimeUs
+{
+public:
+
+	// monotonic time in us, for measurements finer than cTimeMs
+	static uint64_t Now(void);
+
+	// CPU time consumed by the calling thread in us
+	static uint64_t ThreadCpu(void);
+};
+
 #endif
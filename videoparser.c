@@ -0,0 +1,407 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "videoparser.h"
+
+#include <limits.h>
+#include <vdr/tools.h>
+
+#define SPS_MAX_SIZE 256
+
+/*
+ * bit reader for exp-golomb coded syntax elements, reading beyond the end
+ * of the buffer or an exp-golomb code exceeding 32 bits returns zeros and
+ * sets the overflow flag
+ */
+
+class cBitReader
+{
+
+public:
+
+	cBitReader(const unsigned char *data, int length) :
+		m_data(data), m_length(length), m_index(0), m_invalid(false) { }
+
+	unsigned int GetBit(void)
+	{
+		if (m_index >= m_length * 8)
+		{
+			m_index++;
+			return 0;
+		}
+		unsigned int bit = (m_data[m_index >> 3] >> (7 - (m_index & 7))) & 1;
+		m_index++;
+		return bit;
+	}
+
+	unsigned int GetBits(int n)
+	{
+		unsigned int bits = 0;
+		while (n--)
+			bits = (bits << 1) | GetBit();
+		return bits;
+	}
+
+	void SkipBits(int n) { m_index += n; }
+
+	unsigned int GetUe(void)
+	{
+		int leadingZeros = 0;
+		while (!GetBit())
+		{
+			if (++leadingZeros > 31 || Overflow())
+			{
+				m_invalid = true;
+				return 0;
+			}
+		}
+		return ((1u << leadingZeros) - 1) + GetBits(leadingZeros);
+	}
+
+	int GetSe(void)
+	{
+		unsigned int ue = GetUe();
+		return ue & 1 ? (ue + 1) / 2 : -(int)(ue / 2);
+	}
+
+	bool Overflow(void) { return m_invalid || m_index > m_length * 8; }
+
+private:
+
+	const unsigned char *m_data;
+	int m_length;
+	int m_index;
+	bool m_invalid;
+};
+
+bool cVideoParser::GetFrameFormat(cVideoCodec::eCodec codec,
+		const unsigned char *data, int length, cVideoFrameFormat &format)
+{
+	int offset = 0;
+	while (const unsigned char *p = FindStartCode(data, length, offset))
+	{
+		int remaining = length - (p - data);
+
+		if (codec == cVideoCodec::eMPEG2 && p[3] == 0xb3)
+			return ParseMpeg2SequenceHeader(p, remaining, format);
+
+		if (codec == cVideoCodec::eH264 && (p[3] & 0x1f) == 7)
+			return ParseH264Sps(p, remaining, format);
+
+		// stop at first slice / picture
+		if ((codec == cVideoCodec::eMPEG2 && p[3] == 0x00) ||
+				(codec == cVideoCodec::eH264 &&
+						((p[3] & 0x1f) == 1 || (p[3] & 0x1f) == 5)))
+			break;
+	}
+	return false;
+}
+
+cVideoParser::ePictureType cVideoParser::GetPictureType(
+		cVideoCodec::eCodec codec, const unsigned char *data, int length)
+{
+	int offset = 0;
+	while (const unsigned char *p = FindStartCode(data, length, offset))
+	{
+		int remaining = length - (p - data);
+
+		if (codec == cVideoCodec::eMPEG2 && p[3] == 0x00)
+		{
+			if (remaining < 6)
+				break;
+
+			switch ((p[5] >> 3) & 0x07) // picture coding type
+			{
+			case 1:  return eIntra;
+			case 2:  return eReference;
+			case 3:  return eNonReference;
+			default: return eUnknown;
+			}
+		}
+
+		if (codec == cVideoCodec::eH264 &&
+				((p[3] & 0x1f) == 1 || (p[3] & 0x1f) == 5))
+		{
+			// only an IDR picture is decodable on its own for sure, as
+			// pictures following a non-IDR I picture may refer to pictures
+			// preceding it
+			if ((p[3] & 0x1f) == 5)
+				return eIntra;
+
+			return (p[3] & 0x60) ? eReference : eNonReference;
+		}
+	}
+	return eUnknown;
+}
+
+const unsigned char* cVideoParser::FindStartCode(const unsigned char *data,
+		int length, int &offset)
+{
+	for (int i = offset; i + 3 < length; i++)
+	{
+		if (!data[i] && !data[i + 1] && data[i + 2] == 0x01)
+		{
+			offset = i + 3;
+			return data + i;
+		}
+	}
+	return 0;
+}
+
+bool cVideoParser::ParseMpeg2SequenceHeader(const unsigned char *data,
+		int length, cVideoFrameFormat &format)
+{
+	if (length < 12)
+		return false;
+
+	static const int frameRates[16] = {
+		0, 24, 24, 25, 30, 30, 50, 60, 60, 0, 0, 0, 0, 0, 0, 0
+	};
+
+	format.width = (data[4] << 4) | (data[5] >> 4);
+	format.height = ((data[5] & 0x0f) << 8) | data[6];
+	format.frameRate = frameRates[data[7] & 0x0f];
+
+	// aspect ratio information gives the display aspect ratio
+	int darX = 0, darY = 0;
+	switch (data[7] >> 4)
+	{
+	case 2:  darX =   4; darY =   3; break;
+	case 3:  darX =  16; darY =   9; break;
+	case 4:  darX = 221; darY = 100; break;
+	default: break;
+	}
+
+	format.pixelWidth = 1;
+	format.pixelHeight = 1;
+	if (darX && format.width && format.height)
+	{
+		cRational par(darX * format.height, darY * format.width);
+		par.Reduce(INT_MAX);
+		format.pixelWidth = par.num;
+		format.pixelHeight = par.den;
+	}
+
+	// MPEG-1 streams are always progressive, check sequence extension and
+	// take the field order of interlaced streams from the first picture
+	// coding extension
+	format.scanMode = cScanMode::eProgressive;
+	bool progressive = true;
+	int offset = 12;
+	while (const unsigned char *p = FindStartCode(data, length, offset))
+	{
+		if (p[3] == 0xb5 && p + 5 < data + length && (p[4] >> 4) == 1)
+		{
+			progressive = p[5] & 0x08;
+			if (progressive)
+				break;
+		}
+		else if (p[3] == 0xb5 && p + 7 < data + length && (p[4] >> 4) == 8)
+		{
+			// field pictures are given in order, frame pictures tell it
+			int structure = p[6] & 0x03;
+			format.scanMode = structure == 1 ? cScanMode::eTopFieldFirst :
+					structure == 2 ? cScanMode::eBottomFieldFirst :
+					p[7] & 0x80 ? cScanMode::eTopFieldFirst :
+							cScanMode::eBottomFieldFirst;
+			break;
+		}
+		// continue on user data, GOP and picture header only
+		else if (p[3] != 0xb2 && p[3] != 0xb8 && p[3] != 0x00)
+			break;
+	}
+
+	if (!progressive && !format.Interlaced())
+		return false;
+
+	if (format.Interlaced())
+		format.frameRate *= 2;
+
+	return format.width && format.height;
+}
+
+bool cVideoParser::ParseH264Sps(const unsigned char *data, int length,
+		cVideoFrameFormat &format)
+{
+	static const int sampleAspectRatios[17][2] = {
+		{  0,  1 }, {  1,  1 }, { 12, 11 }, { 10, 11 }, { 16, 11 },
+		{ 40, 33 }, { 24, 11 }, { 20, 11 }, { 32, 11 }, { 80, 33 },
+		{ 18, 11 }, { 15, 11 }, { 64, 33 }, {160, 99 }, {  4,  3 },
+		{  3,  2 }, {  2,  1 }
+	};
+
+	// remove emulation prevention bytes
+	unsigned char rbsp[SPS_MAX_SIZE];
+	int rbspLength = 0;
+	for (int i = 4; i < length && rbspLength < SPS_MAX_SIZE; i++)
+	{
+		if (i + 2 < length && !data[i] && !data[i + 1] && data[i + 2] == 0x03)
+		{
+			rbsp[rbspLength++] = data[i++];
+			if (rbspLength < SPS_MAX_SIZE)
+				rbsp[rbspLength++] = data[i++];
+		}
+		else if (i + 2 < length && !data[i] && !data[i + 1] &&
+				data[i + 2] <= 0x01)
+			break;
+		else
+			rbsp[rbspLength++] = data[i];
+	}
+
+	cBitReader br(rbsp, rbspLength);
+
+	int profile = br.GetBits(8);
+	br.SkipBits(16); // constraint flags, level
+	br.GetUe();      // sps id
+
+	int chromaFormat = 1;
+	if (profile == 100 || profile == 110 || profile == 122 || profile == 244 ||
+			profile ==  44 || profile ==  83 || profile ==  86 ||
+			profile == 118 || profile == 128 || profile == 138 ||
+			profile == 139 || profile == 134 || profile == 135)
+	{
+		chromaFormat = br.GetUe();
+		if (chromaFormat == 3)
+			br.SkipBits(1); // separate colour plane
+		br.GetUe();         // bit depth luma
+		br.GetUe();         // bit depth chroma
+		br.SkipBits(1);     // qpprime y zero transform bypass
+
+		if (br.GetBit()) // seq scaling matrix present
+		{
+			for (int i = 0; i < (chromaFormat != 3 ? 8 : 12); i++)
+			{
+				if (br.GetBit())
+				{
+					int last = 8, next = 8;
+					for (int j = 0; j < (i < 6 ? 16 : 64) && next; j++)
+					{
+						next = (last + br.GetSe() + 256) % 256;
+						last = next ? next : last;
+					}
+				}
+			}
+		}
+	}
+
+	br.GetUe(); // log2 max frame num
+	switch (br.GetUe()) // pic order count type
+	{
+	case 0:
+		br.GetUe(); // log2 max pic order cnt lsb
+		break;
+
+	case 1:
+	{
+		br.SkipBits(1); // delta pic order always zero
+		br.GetSe();     // offset for non ref pic
+		br.GetSe();     // offset for top to bottom field
+		int n = br.GetUe();
+		for (int i = 0; i < n && !br.Overflow(); i++)
+			br.GetSe();
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	br.GetUe();     // max num ref frames
+	br.SkipBits(1); // gaps in frame num allowed
+
+	int widthInMbs = br.GetUe() + 1;
+	int heightInMapUnits = br.GetUe() + 1;
+	int frameMbsOnly = br.GetBit();
+	if (!frameMbsOnly)
+		br.SkipBits(1); // mb adaptive frame field
+	br.SkipBits(1);     // direct 8x8 inference
+
+	format.width = widthInMbs * 16;
+	format.height = (2 - frameMbsOnly) * heightInMapUnits * 16;
+
+	if (br.GetBit()) // frame cropping
+	{
+		int cropX = chromaFormat == 1 || chromaFormat == 2 ? 2 : 1;
+		int cropY = (chromaFormat == 1 ? 2 : 1) * (2 - frameMbsOnly);
+
+		int left = br.GetUe(), right = br.GetUe();
+		int top = br.GetUe(), bottom = br.GetUe();
+
+		format.width -= (left + right) * cropX;
+		format.height -= (top + bottom) * cropY;
+	}
+
+	format.pixelWidth = 1;
+	format.pixelHeight = 1;
+	format.frameRate = 0;
+	format.scanMode = cScanMode::eProgressive;
+
+	if (br.GetBit()) // vui parameters present
+	{
+		if (br.GetBit()) // aspect ratio info present
+		{
+			int idc = br.GetBits(8);
+			if (idc == 255)
+			{
+				format.pixelWidth = br.GetBits(16);
+				format.pixelHeight = br.GetBits(16);
+			}
+			else if (idc > 0 && idc < 17)
+			{
+				format.pixelWidth = sampleAspectRatios[idc][0];
+				format.pixelHeight = sampleAspectRatios[idc][1];
+			}
+		}
+		if (br.GetBit())     // overscan info present
+			br.SkipBits(1);  // overscan appropriate
+
+		if (br.GetBit())     // video signal type present
+		{
+			br.SkipBits(4);  // video format, full range
+			if (br.GetBit()) // colour description present
+				br.SkipBits(24);
+		}
+		if (br.GetBit())     // chroma location info present
+		{
+			br.GetUe();
+			br.GetUe();
+		}
+		if (br.GetBit())     // timing info present
+		{
+			unsigned int unitsInTick = br.GetBits(32);
+			unsigned int timeScale = br.GetBits(32);
+
+			// round up as done with the decoder's frame rate
+			if (unitsInTick)
+				format.frameRate =
+						(timeScale + 2 * unitsInTick - 1) / (2 * unitsInTick);
+		}
+	}
+
+	if (!format.pixelWidth || !format.pixelHeight)
+	{
+		format.pixelWidth = 1;
+		format.pixelHeight = 1;
+	}
+
+	// the field order is only given per picture, so leave interlaced
+	// streams to the decoder
+	return !br.Overflow() && frameMbsOnly &&
+			format.width > 0 && format.height > 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef VIDEO_PARSER_H
+#define VIDEO_PARSER_H
+
+#include "tools.h"
+
+class cVideoParser
+{
+
+public:
+
+	enum ePictureType {
+		eUnknown,
+		eIntra,			// MPEG-2 I picture or H.264 IDR, decodable on its own
+		eReference,		// P picture or H.264 non-IDR reference slice
+		eNonReference	// B picture or H.264 slice with nal_ref_idc == 0
+	};
+
+	static const char* Str(ePictureType type) {
+		return  (type == eIntra)        ? "intra"         :
+				(type == eReference)    ? "reference"     :
+				(type == eNonReference) ? "non-reference" : "unknown";
+	}
+
+	// get frame format from MPEG-2 sequence header or H.264 SPS, if found
+	// in the given elementary stream data, interlaced formats are only
+	// reported if the field order is known, which is never the case for
+	// H.264, since it's not part of the SPS
+	static bool GetFrameFormat(cVideoCodec::eCodec codec,
+			const unsigned char *data, int length, cVideoFrameFormat &format);
+
+	// get the type of the first picture or slice in the given elementary
+	// stream data, used to drop frames during fast trick speeds
+	static ePictureType GetPictureType(cVideoCodec::eCodec codec,
+			const unsigned char *data, int length);
+
+private:
+
+	static const unsigned char* FindStartCode(const unsigned char *data,
+			int length, int &offset);
+
+	static bool ParseMpeg2SequenceHeader(const unsigned char *data, int length,
+			cVideoFrameFormat &format);
+
+	static bool ParseH264Sps(const unsigned char *data, int length,
+			cVideoFrameFormat &format);
+
+	cVideoParser();
+};
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "zapstat.h"
+#include "tools.h"
+
+#include <vdr/thread.h>
+#include <vdr/tools.h>
+
+cRpiZapStat* cRpiZapStat::s_instance = 0;
+
+cRpiZapStat* cRpiZapStat::GetInstance(void)
+{
+	if (!s_instance)
+		s_instance = new cRpiZapStat();
+
+	return s_instance;
+}
+
+void cRpiZapStat::DropInstance(void)
+{
+	cRpiZapStat* instance = s_instance;
+	s_instance = 0;
+	delete instance;
+}
+
+cRpiZapStat::cRpiZapStat() :
+	m_mutex(new cMutex()),
+	m_active(false),
+	m_partial(false),
+	m_start(0),
+	m_numZaps(0),
+	m_codecChange(-1)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		m_codecChangeMs[i] = 0;
+		m_numCodecChanges[i] = 0;
+	}
+
+	for (int i = 0; i < eNumEvents; i++)
+		m_events[i] = -1;
+
+	for (int i = 0; i < ZAPSTAT_HISTORY; i++)
+		m_history[i] = 0;
+}
+
+cRpiZapStat::~cRpiZapStat()
+{
+	delete m_mutex;
+}
+
+void cRpiZapStat::Start(void)
+{
+	cRpiZapStat* instance = s_instance;
+	if (!instance)
+		return;
+
+	instance->m_mutex->Lock();
+
+	// log what we've got so far from an unfinished zap
+	if (instance->m_active)
+		instance->Finish();
+
+	for (int i = 0; i < eNumEvents; i++)
+		instance->m_events[i] = -1;
+
+	instance->m_start = cTimeUs::Now();
+	instance->m_active = true;
+	instance->m_partial = false;
+	instance->m_codecChange = -1;
+	instance->m_mutex->Unlock();
+}
+
+void cRpiZapStat::Mark(eEvent event)
+{
+	cRpiZapStat* instance = s_instance;
+	if (!instance)
+		return;
+
+	// only the first occurrence of each event after start is of interest,
+	// so skip the lock for everything else
+	if (!instance->m_active || instance->m_events[event] >= 0)
+		return;
+
+	instance->m_mutex->Lock();
+	if (instance->m_active && instance->m_events[event] < 0)
+	{
+		instance->m_events[event] = cTimeUs::Now() - instance->m_start;
+		instance->Check();
+	}
+	instance->m_mutex->Unlock();
+}
+
+void cRpiZapStat::CodecChange(bool standby)
+{
+	cRpiZapStat* instance = s_instance;
+	if (!instance)
+		return;
+
+	instance->m_mutex->Lock();
+	if (instance->m_active)
+		instance->m_codecChange = standby ? 1 : 0;
+	instance->m_mutex->Unlock();
+}
+
+void cRpiZapStat::Poll(void)
+{
+	cRpiZapStat* instance = s_instance;
+	if (!instance)
+		return;
+
+	instance->m_mutex->Lock();
+	if (instance->m_active && instance->m_partial)
+		instance->Check();
+	instance->m_mutex->Unlock();
+}
+
+void cRpiZapStat::Check(void)
+{
+	bool audioUp = m_events[eFirstAudioEmptied] >= 0;
+	bool videoUp = m_events[eRenderTunnel] >= 0;
+
+	if (audioUp && videoUp)
+	{
+		Finish();
+		return;
+	}
+
+	// give the other stream some time to show up
+	m_partial = IsComplete();
+	if (m_partial && cTimeUs::Now() - m_start >
+			(uint64_t)(ZAPSTAT_SETTLE * 1000 + (audioUp ?
+			m_events[eFirstAudioEmptied] : m_events[eRenderTunnel])))
+		Finish();
+}
+
+bool cRpiZapStat::IsComplete(void)
+{
+	bool audio = m_events[eFirstAudio] >= 0;
+	bool video = m_events[eFirstVideo] >= 0;
+
+	return (audio || video) &&
+			(!audio || m_events[eFirstAudioEmptied] >= 0) &&
+			(!video || m_events[eRenderTunnel] >= 0);
+}
+
+void cRpiZapStat::Finish(void)
+{
+	bool complete = IsComplete();
+
+	int total = 0;
+	cString breakdown = "";
+	for (int i = 0; i < eNumEvents; i++)
+	{
+		if (m_events[i] >= 0)
+		{
+			breakdown = cString::sprintf("%s, %s +%dms", *breakdown,
+					Str((eEvent)i), m_events[i] / 1000);
+			if (m_events[i] > total)
+				total = m_events[i];
+		}
+	}
+	total /= 1000;
+
+	DLOG("zap time %dms%s%s%s", total, complete ? "" : " (incomplete)",
+			m_codecChange < 0 ? "" : m_codecChange ?
+					", codec change (standby decoder)" : ", codec change",
+			*breakdown);
+
+	if (complete)
+	{
+		m_history[m_numZaps % ZAPSTAT_HISTORY] = total;
+		m_numZaps++;
+
+		if (m_codecChange >= 0)
+		{
+			m_codecChangeMs[m_codecChange] += total;
+			m_numCodecChanges[m_codecChange]++;
+		}
+		DLOG("%s", *History());
+	}
+	m_active = false;
+	m_partial = false;
+}
+
+cString cRpiZapStat::History(void)
+{
+	static const int s_bucketMs = 250;
+	static const int s_numBuckets = 8;
+	int buckets[s_numBuckets] = { 0 };
+
+	int n = m_numZaps < ZAPSTAT_HISTORY ? m_numZaps : ZAPSTAT_HISTORY;
+	int min = 0, avg = 0, max = 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		if (!i || m_history[i] < min)
+			min = m_history[i];
+		if (m_history[i] > max)
+			max = m_history[i];
+		avg += m_history[i];
+
+		int bucket = m_history[i] / s_bucketMs;
+		buckets[bucket < s_numBuckets ? bucket : s_numBuckets - 1]++;
+	}
+	if (n)
+		avg /= n;
+
+	cString histogram = "";
+	for (int i = 0; i < s_numBuckets; i++)
+		histogram = cString::sprintf("%s %s%d:%d", *histogram,
+				i < s_numBuckets - 1 ? "<" : ">=",
+				i < s_numBuckets - 1 ? (i + 1) * s_bucketMs : i * s_bucketMs,
+				buckets[i]);
+
+	// averages of all codec changes so far, as they're comparatively rare
+	cString codecChanges = "";
+	for (int i = 0; i < 2; i++)
+		if (m_numCodecChanges[i])
+			codecChanges = cString::sprintf("%s, codec change%s: %d, avg=%dms",
+					*codecChanges, i ? " with standby decoder" : "",
+					m_numCodecChanges[i],
+					m_codecChangeMs[i] / m_numCodecChanges[i]);
+
+	return cString::sprintf("zap time of last %d zaps: min=%dms, avg=%dms, "
+			"max=%dms,%s%s", n, min, avg, max, *histogram, *codecChanges);
+}
+
+cString cRpiZapStat::Status(void)
+{
+	cRpiZapStat* instance = s_instance;
+	if (!instance)
+		return "";
+
+	instance->m_mutex->Lock();
+	cString ret = instance->History();
+	instance->m_mutex->Unlock();
+	return ret;
+}
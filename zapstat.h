@@ -0,0 +1,115 @@
+/*
+ * rpihddevice - VDR HD output device for Raspberry Pi
+ * Copyright (C) 2026 rpihddevice contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ZAPSTAT_H
+#define ZAPSTAT_H
+
+#include <stdint.h>
+#include <vdr/tools.h>
+
+class cMutex;
+
+/*
+ * Records the time stamps of the start-up chain after a channel switch or
+ * a jump in a recording. Each zap is logged with its breakdown, the total
+ * time of the last ZAPSTAT_HISTORY zaps is kept for a histogram. A zap is
+ * complete once all of its streams are up, where a stream is up with the
+ * render tunnel set up for video or the first buffer played for audio. If
+ * only audio or video has shown up, the zap is completed ZAPSTAT_SETTLE ms
+ * after that stream is up.
+ */
+
+#define ZAPSTAT_HISTORY 32
+#define ZAPSTAT_SETTLE  2000 // ms
+
+class cRpiZapStat
+{
+
+public:
+
+	enum eEvent {
+		eFirstAudio,
+		eFirstVideo,
+		eStartClock,
+		eVideoFormat,
+		eDisplayMode,
+		eRenderTunnel,
+		eFirstAudioEmptied,
+		eNumEvents
+	};
+
+	static const char* Str(eEvent event) {
+		return  (event == eFirstAudio)        ? "first audio"    :
+				(event == eFirstVideo)        ? "first video"    :
+				(event == eStartClock)        ? "start clock"    :
+				(event == eVideoFormat)       ? "video format"   :
+				(event == eDisplayMode)       ? "display mode"   :
+				(event == eRenderTunnel)      ? "render tunnel"  :
+				(event == eFirstAudioEmptied) ? "audio emptied"  : "unknown";
+	}
+
+	// the instance is created on plugin initialization, before any of the
+	// threads using it are started, all calls are no-ops without it
+	static cRpiZapStat* GetInstance(void);
+	static void DropInstance(void);
+
+	static void Start(void);
+	static void Mark(eEvent event);
+
+	// current zap changes the video codec, with or without a decoder which
+	// has been set up for the new codec in advance
+	static void CodecChange(bool standby);
+
+	// to be called periodically, completes zaps with a single stream
+	static void Poll(void);
+
+	// summary and histogram of the last zaps
+	static cString Status(void);
+
+private:
+
+	cRpiZapStat();
+	virtual ~cRpiZapStat();
+
+	void Check(void);
+	void Finish(void);
+	bool IsComplete(void);
+	cString History(void);
+
+	static cRpiZapStat *s_instance;
+
+	cMutex   *m_mutex;
+	bool      m_active;
+	bool      m_partial; // only audio or video is up so far
+	uint64_t  m_start;
+	int       m_events[eNumEvents];
+
+	int       m_history[ZAPSTAT_HISTORY];
+	int       m_numZaps;
+
+	// zaps with video codec change, with and without standby decoder
+	int       m_codecChange; // of current zap, -1: none, 0: cold, 1: standby
+	int       m_codecChangeMs[2];
+	int       m_numCodecChanges[2];
+
+	cRpiZapStat(const cRpiZapStat&);
+	cRpiZapStat& operator= (const cRpiZapStat&);
+};
+
+#endif